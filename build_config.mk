@@ -0,0 +1,5 @@
+PLATFORM_CFLAGS=-pthread -DOS_LINUX
+PLATFORM_LDFLAGS=-lpthread
+PLATFORM=OS_LINUX
+SNAPPY=0
+PORT_CFLAGS=-fno-builtin-memcmp -DLEVELDB_PLATFORM_POSIX
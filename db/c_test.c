@@ -282,6 +282,36 @@ int main(int argc, char** argv) {
     CheckGet(db, roptions, "box", "c");
   }
 
+  StartPhase("filter");
+  {
+    leveldb_filterpolicy_t* policy = leveldb_filterpolicy_create_bloom(10);
+    leveldb_close(db);
+    leveldb_destroy_db(options, dbname, &err);
+    CheckNoError(err);
+    leveldb_options_set_filter_policy(options, policy);
+    leveldb_options_set_create_if_missing(options, 1);
+    db = leveldb_open(options, dbname, &err);
+    CheckNoError(err);
+    leveldb_put(db, woptions, "foo", 3, "foovalue", 8, &err);
+    CheckNoError(err);
+    leveldb_put(db, woptions, "bar", 3, "barvalue", 8, &err);
+    CheckNoError(err);
+    CheckGet(db, roptions, "foo", "foovalue");
+    CheckGet(db, roptions, "bar", "barvalue");
+    CheckGet(db, roptions, "box", NULL);
+    leveldb_close(db);
+    db = leveldb_open(options, dbname, &err);
+    CheckNoError(err);
+    CheckGet(db, roptions, "foo", "foovalue");
+    CheckGet(db, roptions, "box", NULL);
+    leveldb_close(db);
+    leveldb_options_set_filter_policy(options, NULL);
+    leveldb_filterpolicy_destroy(policy);
+    db = leveldb_open(options, dbname, &err);
+    CheckNoError(err);
+    CheckGet(db, roptions, "foo", "foovalue");
+  }
+
   StartPhase("cleanup");
   leveldb_close(db);
   leveldb_options_destroy(options);
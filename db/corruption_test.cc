@@ -11,6 +11,7 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 #include "leveldb/write_batch.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
@@ -81,6 +82,21 @@ class CorruptionTest {
     }
   }
 
+  // Ingest a table mapping each of the sorted "keys" to "v" + key
+  void Ingest(const std::vector<std::string>& keys) {
+    const std::string ext = dbname_ + "_ext.sst";
+    WritableFile* file;
+    ASSERT_OK(env_.NewWritableFile(ext, &file));
+    TableBuilder builder(Options(), file);
+    for (size_t i = 0; i < keys.size(); i++) {
+      builder.Add(keys[i], "v" + keys[i]);
+    }
+    ASSERT_OK(builder.Finish());
+    ASSERT_OK(file->Close());
+    delete file;
+    ASSERT_OK(db_->IngestExternalFiles(std::vector<std::string>(1, ext)));
+  }
+
   void Check(int min_expected, int max_expected) {
     int next_expected = 0;
     int missed = 0;
@@ -255,6 +271,72 @@ TEST(CorruptionTest, MissingDescriptor) {
   Check(1000, 1000);
 }
 
+TEST(CorruptionTest, RepairKeepsIngestedTable) {
+  Build(10);
+  // 8-byte big-endian keys also parse as internal keys
+  std::vector<std::string> keys;
+  for (int i = 1; i <= 10; i++) {
+    keys.push_back(std::string(7, '\0') + static_cast<char>(i));
+  }
+  Ingest(keys);
+  ASSERT_OK(db_->Put(WriteOptions(), keys[0], "later"));
+
+  RepairDB();
+  Reopen();
+  Check(10, 10);
+  std::string v;
+  ASSERT_OK(db_->Get(ReadOptions(), keys[0], &v));
+  ASSERT_EQ("later", v);
+  ASSERT_OK(db_->Get(ReadOptions(), keys[5], &v));
+  ASSERT_EQ("v" + keys[5], v);
+}
+
+TEST(CorruptionTest, RepairArchivesIngestedTable) {
+  // Start without files archived by earlier repairs
+  const std::string lost = PathJoin(dbname_, "lost");
+  std::vector<std::string> filenames;
+  env_.GetChildren(lost, &filenames);  // Ignore error
+  for (size_t i = 0; i < filenames.size(); i++) {
+    env_.DeleteFile(PathJoin(lost, filenames[i]));
+  }
+
+  Build(10);
+  std::vector<std::string> keys;
+  std::string key_space;
+  for (int i = 100; i < 110; i++) {
+    keys.push_back(Key(i, &key_space).ToString());
+  }
+  Ingest(keys);
+
+  // Without a descriptor naming it, the ingested table's sequence
+  // number is lost, so it is set aside rather than misread.
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(env_.GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        type == kDescriptorFile) {
+      ASSERT_OK(env_.DeleteFile(PathJoin(dbname_, filenames[i])));
+    }
+  }
+  Status s = ::leveldb::RepairDB(dbname_, options_);
+  ASSERT_TRUE(Slice(s.ToString()).starts_with("Corruption"))
+      << s.ToString();
+  Reopen();
+  Check(10, 10);
+
+  ASSERT_OK(env_.GetChildren(lost, &filenames));
+  int lost_tables = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+      lost_tables++;
+    }
+  }
+  ASSERT_EQ(1, lost_tables);
+}
+
 TEST(CorruptionTest, SequenceNumberRecovery) {
   ASSERT_OK(db_->Put(WriteOptions(), "foo", "v1"));
   ASSERT_OK(db_->Put(WriteOptions(), "foo", "v2"));
@@ -321,6 +403,9 @@ TEST(CorruptionTest, CompactionInputErrorParanoid) {
     dbi->Put(WriteOptions(), "~", "end");
     dbi->TEST_CompactMemTable();
   }
+  // Flushes no longer wait for compactions; let the level-0 compaction
+  // triggered above finish before checking the file layout.
+  dbi->TEST_CompactRange(0, NULL, NULL);
 
   Build(10);
   dbi->TEST_CompactMemTable();
@@ -11,6 +11,8 @@
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/prefix_extractor.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -29,12 +31,17 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readhot       -- read N times in random order from 1% section of DB
+//      seekprefix    -- scan the keys under N random key prefixes
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
+//      cachestats  -- Print the hits, misses and usage of each shard of
+//                     the block cache
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -79,10 +86,54 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// If true, members of a write group insert into the memtable in parallel
+// (initialized to default value by "main")
+static bool FLAGS_concurrent_memtable_write = false;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, the cache set up by --cache_size uses CLOCK eviction
+// instead of LRU.
+static bool FLAGS_clock_cache = false;
+
+// Number of bits of key hash that pick the shard of the LRU cache set
+// up by --cache_size.  Negative means use the default shard count.
+static int FLAGS_cache_shard_bits = -1;
+
+// If positive, the cache set up by --cache_size is a scan-resistant
+// segmented LRU cache whose protected list holds this fraction of it.
+static double FLAGS_cache_protected_fraction = 0;
+
+// Number of bytes to use as a cache of compressed blocks, below the
+// cache of uncompressed data.  Zero means no compressed block cache.
+static int FLAGS_compressed_cache_size = 0;
+
+// Number of bytes to use as a cache of key/value pairs found by reads.
+// Zero means no row cache.
+static int FLAGS_row_cache_size = 0;
+
+// Bloom filter bits per key.
+// Negative means use default settings.
+static int FLAGS_bloom_bits = -1;
+
+// Length of the key prefixes that seekprefix scans
+static int FLAGS_prefix_size = 12;
+
+// If true, use a prefix extractor for the first --prefix_size bytes of
+// each key, so that filters can rule out prefixes.
+static bool FLAGS_use_prefix_extractor = false;
+
+// If true, data blocks carry a hash index for point lookups
+static bool FLAGS_data_block_hash_index = false;
+
+// Size of index partitions (use a single index block per table if == 0)
+static int FLAGS_index_partition_size = 0;
+
+// If true, read table files through memory mappings
+static bool FLAGS_mmap_read = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -91,6 +142,9 @@ static int FLAGS_open_files = 0;
 // benchmark will fail.
 static bool FLAGS_use_existing_db = false;
 
+// If true, skip the write-ahead log for all writes
+static bool FLAGS_disable_wal = false;
+
 // Use the db with the following name.
 #if defined(LEVELDB_PLATFORM_WINDOWS)
 static const char* FLAGS_db = "dbbench";
@@ -298,6 +352,10 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  Cache* row_cache_;
+  const FilterPolicy* filter_policy_;
+  const PrefixExtractor* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -382,7 +440,19 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
+  : cache_(FLAGS_cache_size < 0 ? NULL : NewBlockCache()),
+    compressed_cache_(FLAGS_compressed_cache_size > 0
+                      ? NewLRUCache(FLAGS_compressed_cache_size)
+                      : NULL),
+    row_cache_(FLAGS_row_cache_size > 0
+               ? NewLRUCache(FLAGS_row_cache_size)
+               : NULL),
+    filter_policy_(FLAGS_bloom_bits >= 0
+                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                   : NULL),
+    prefix_extractor_(FLAGS_use_prefix_extractor
+                      ? NewFixedPrefixExtractor(FLAGS_prefix_size)
+                      : NULL),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -404,6 +474,10 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete row_cache_;
+    delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -428,6 +502,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = NULL;
       bool fresh_db = false;
@@ -450,6 +525,7 @@ class Benchmark {
         fresh_db = true;
         num_ /= 1000;
         write_options_.sync = true;
+        write_options_.disable_wal = false;
         method = &Benchmark::WriteRandom;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
@@ -462,8 +538,14 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("readmissing")) {
+        method = &Benchmark::ReadMissing;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
+      } else if (name == Slice("seekprefix")) {
+        method = &Benchmark::SeekPrefix;
       } else if (name == Slice("readrandomsmall")) {
         reads_ /= 1000;
         method = &Benchmark::ReadRandom;
@@ -484,6 +566,8 @@ class Benchmark {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats();
+      } else if (name == Slice("cachestats")) {
+        PrintCacheStats();
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -673,7 +757,15 @@ class Benchmark {
     Options options;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.block_cache_compressed = compressed_cache_;
+    options.row_cache = row_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.filter_policy = filter_policy_;
+    options.prefix_extractor = prefix_extractor_;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.use_mmap_reads = FLAGS_mmap_read;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -757,6 +849,39 @@ class Benchmark {
     }
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    const int kBatchSize = 100;
+    char keys[kBatchSize][100];
+    Slice key_slices[kBatchSize];
+    std::string values[kBatchSize];
+    Status statuses[kBatchSize];
+    for (int i = 0; i < reads_; i += kBatchSize) {
+      const int n = (reads_ - i < kBatchSize) ? reads_ - i : kBatchSize;
+      for (int j = 0; j < n; j++) {
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(keys[j], sizeof(keys[j]), "%016d", k);
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices, n, values, statuses);
+      for (int j = 0; j < n; j++) {
+        thread->stats.FinishedSingleOp();
+      }
+    }
+  }
+
+  void ReadMissing(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d.", k);
+      db_->Get(options, key, &value);
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
   void ReadHot(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -770,6 +895,28 @@ class Benchmark {
     }
   }
 
+  void SeekPrefix(ThreadState* thread) {
+    ReadOptions options;
+    options.prefix_same_as_start = true;
+    Iterator* iter = db_->NewIterator(options);
+    const int prefix_size = (FLAGS_prefix_size < 16 ? FLAGS_prefix_size : 16);
+    int64_t bytes = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      const Slice prefix(key, prefix_size);
+      for (iter->Seek(prefix);
+           iter->Valid() && iter->key().starts_with(prefix);
+           iter->Next()) {
+        bytes += iter->key().size() + iter->value().size();
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
@@ -812,6 +959,39 @@ class Benchmark {
     fprintf(stdout, "\n%s\n", stats.c_str());
   }
 
+  static Cache* NewBlockCache() {
+    if (FLAGS_clock_cache) {
+      return NewClockCache(FLAGS_cache_size, Options().block_size);
+    }
+    const int shard_bits =
+        FLAGS_cache_shard_bits >= 0 ? FLAGS_cache_shard_bits : 4;
+    if (FLAGS_cache_protected_fraction > 0) {
+      return NewSegmentedLRUCache(FLAGS_cache_size, shard_bits,
+                                  FLAGS_cache_protected_fraction);
+    }
+    return NewLRUCache(FLAGS_cache_size, shard_bits);
+  }
+
+  void PrintCacheStats() {
+    std::vector<CacheShardStats> stats;
+    if (cache_ != NULL) {
+      cache_->GetShardStats(&stats);
+    }
+    if (stats.empty()) {
+      fprintf(stdout, "\n(no block cache statistics)\n");
+      return;
+    }
+    fprintf(stdout, "\nShard       Hits     Misses  Usage(MB)\n"
+            "--------------------------------------\n");
+    for (size_t s = 0; s < stats.size(); s++) {
+      fprintf(stdout, "%5d %10llu %10llu %10.3f\n",
+              static_cast<int>(s),
+              static_cast<unsigned long long>(stats[s].hits),
+              static_cast<unsigned long long>(stats[s].misses),
+              stats[s].usage / 1048576.0);
+    }
+  }
+
   static void WriteToFile(void* arg, const char* buf, int n) {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
@@ -839,6 +1019,8 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_concurrent_memtable_write =
+      leveldb::Options().allow_concurrent_memtable_write;
 
   for (int i = 1; i < argc; i++) {
     double d;
@@ -854,6 +1036,12 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -866,6 +1054,37 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 20) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--cache_protected_fraction=%lf%c",
+                      &d, &junk) == 1 && d >= 0 && d < 1) {
+      FLAGS_cache_protected_fraction = d;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf(argv[i], "--use_prefix_extractor=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_use_prefix_extractor = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--mmap_read=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_mmap_read = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
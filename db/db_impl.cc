@@ -30,11 +30,39 @@
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 
 namespace leveldb {
 
+// Information kept for every waiting writer
+struct DBImpl::Writer {
+  Status status;
+  WriteBatch* batch;
+  bool sync;
+  bool disable_wal;
+  bool done;
+  port::CondVar cv;
+
+  // Last sequence number used by this writer's group.  Only set on
+  // group leaders.
+  SequenceNumber last_sequence;
+
+  // Set by the group leader when this writer should insert its own
+  // batch into the memtable alongside the rest of its group.
+  Writer* insert_leader;
+
+  // Only used on group leaders: the number of group members that have
+  // not finished their parallel memtable inserts, and the first error
+  // any of them hit.
+  int pending_inserts;
+  Status insert_status;
+
+  explicit Writer(port::Mutex* mu)
+      : cv(mu), last_sequence(0), insert_leader(NULL), pending_inserts(0) { }
+};
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -76,11 +104,17 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 }
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
+                        const InternalFilterPolicy* ipolicy,
+                        const InternalPrefixExtractor* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
+  result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  result.prefix_extractor = (src.prefix_extractor != NULL) ? iprefix : NULL;
   ClipToRange(&result.max_open_files,           20,     50000);
   ClipToRange(&result.write_buffer_size,        64<<10, 1<<30);
+  ClipToRange(&result.max_write_buffer_number,  2,      64);
+  ClipToRange(&result.recycle_log_file_num,     0,      64);
   ClipToRange(&result.block_size,               1<<10,  4<<20);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
@@ -101,7 +135,11 @@ Options SanitizeOptions(const std::string& dbname,
 DBImpl::DBImpl(const Options& options, const std::string& dbname)
     : env_(options.env),
       internal_comparator_(options.comparator),
-      options_(SanitizeOptions(dbname, &internal_comparator_, options)),
+      internal_filter_policy_(options.filter_policy, options.prefix_extractor),
+      internal_prefix_extractor_(options.prefix_extractor),
+      options_(SanitizeOptions(dbname, &internal_comparator_,
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, options)),
       owns_info_log_(options_.info_log != options.info_log),
       owns_cache_(options_.block_cache != options.block_cache),
       dbname_(dbname),
@@ -109,16 +147,23 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
       shutting_down_(NULL),
       bg_cv_(&mutex_),
       mem_(new MemTable(internal_comparator_)),
-      imm_(NULL),
+      super_version_(NULL),
+      published_sequence_(NULL),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
-      logger_(NULL),
-      logger_cv_(&mutex_),
+      first_recyclable_log_(0),
       bg_compaction_scheduled_(false),
-      manual_compaction_(NULL) {
+      bg_flush_scheduled_(false),
+      manifest_writing_(false),
+      bg_compaction_paused_(0),
+      manual_compaction_(NULL),
+      flush_wait_micros_(0) {
   mem_->Ref();
-  has_imm_.Release_Store(NULL);
+  for (int i = 0; i < kNumReadSlots; i++) {
+    read_slots_[i].sv.NoBarrier_Store(NULL);
+    read_slots_[i].seek_samples = 0;
+  }
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options.max_open_files - 10;
@@ -132,9 +177,21 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_compaction_scheduled_ || bg_flush_scheduled_) {
     bg_cv_.Wait();
   }
+  // No reader is active any more, so every slot is empty or caches a
+  // reference.
+  for (int i = 0; i < kNumReadSlots; i++) {
+    void* p = read_slots_[i].sv.NoBarrier_Load();
+    if (p != NULL) {
+      UnrefSuperVersion(reinterpret_cast<SuperVersion*>(p));
+    }
+  }
+  if (super_version_.NoBarrier_Load() != NULL) {
+    UnrefSuperVersion(
+        reinterpret_cast<SuperVersion*>(super_version_.NoBarrier_Load()));
+  }
   mutex_.Unlock();
 
   if (db_lock_ != NULL) {
@@ -143,7 +200,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i].mem->Unref();
+  }
   delete log_;
   delete logfile_;
   delete table_cache_;
@@ -198,6 +257,8 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
 }
 
 void DBImpl::DeleteObsoleteFiles() {
+  mutex_.AssertHeld();
+
   // Make a set of all of the live files
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
@@ -206,6 +267,7 @@ void DBImpl::DeleteObsoleteFiles() {
   env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
   uint64_t number;
   FileType type;
+  std::vector<uint64_t> tables_to_delete;
   for (size_t i = 0; i < filenames.size(); i++) {
     if (ParseFileName(filenames[i], &number, &type)) {
       bool keep = true;
@@ -213,6 +275,18 @@ void DBImpl::DeleteObsoleteFiles() {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
                   (number == versions_->PrevLogNumber()));
+          if (!keep && first_recyclable_log_ != 0 &&
+              number >= first_recyclable_log_) {
+            // Hold on to the log for NewLogFile() instead of deleting it
+            if (std::find(log_recycle_files_.begin(), log_recycle_files_.end(),
+                          number) != log_recycle_files_.end()) {
+              keep = true;
+            } else if (log_recycle_files_.size() <
+                       static_cast<size_t>(options_.recycle_log_file_num)) {
+              log_recycle_files_.push_back(number);
+              keep = true;
+            }
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -235,16 +309,31 @@ void DBImpl::DeleteObsoleteFiles() {
       }
 
       if (!keep) {
-        if (type == kTableFile) {
-          table_cache_->Evict(number);
-        }
         Log(options_.info_log, "Delete type=%d #%lld\n",
             int(type),
             static_cast<unsigned long long>(number));
-        env_->DeleteFile(PathJoin(dbname_, filenames[i]));
+        if (type == kTableFile) {
+          tables_to_delete.push_back(number);
+        } else {
+          // Deleted under the mutex, since another call may otherwise
+          // keep a log we are deleting for recycling.
+          env_->DeleteFile(PathJoin(dbname_, filenames[i]));
+        }
       }
     }
   }
+
+  // Evicting a table walks its index to erase its blocks from the block
+  // cache.  Table numbers are never reused or recycled, so do that and
+  // the deletions without blocking other threads.
+  if (!tables_to_delete.empty()) {
+    mutex_.Unlock();
+    for (size_t i = 0; i < tables_to_delete.size(); i++) {
+      table_cache_->Evict(tables_to_delete[i]);
+      env_->DeleteFile(TableFileName(dbname_, tables_to_delete[i]));
+    }
+    mutex_.Lock();
+  }
 }
 
 Status DBImpl::Recover(VersionEdit* edit) {
@@ -365,7 +454,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
   log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
+                     0/*initial_offset*/, log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
@@ -400,7 +489,12 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
     }
 
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = WriteLevel0Table(mem, edit, NULL);
+      // No background work runs during recovery, so the table need not
+      // stay in pending_outputs_ until the edit is applied.
+      uint64_t file_number;
+      status = WriteLevel0Table(std::vector<MemTable*>(1, mem), edit, false,
+                                &file_number);
+      pending_outputs_.erase(file_number);
       if (!status.ok()) {
         // Reflect errors immediately so that conditions like full
         // file-systems cause the DB::Open() to fail.
@@ -412,7 +506,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   }
 
   if (status.ok() && mem != NULL) {
-    status = WriteLevel0Table(mem, edit, NULL);
+    uint64_t file_number;
+    status = WriteLevel0Table(std::vector<MemTable*>(1, mem), edit, false,
+                              &file_number);
+    pending_outputs_.erase(file_number);
     // Reflect errors immediately so that conditions like full
     // file-systems cause the DB::Open() to fail.
   }
@@ -422,16 +519,28 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, bool pick_level,
+                                uint64_t* file_number) {
   mutex_.AssertHeld();
+  assert(!mems.empty());
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long) meta.number);
+  *file_number = meta.number;
+  Iterator* iter;
+  if (mems.size() == 1) {
+    iter = mems[0]->NewIterator();
+  } else {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < mems.size(); i++) {
+      list.push_back(mems[i]->NewIterator());
+    }
+    iter = NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  }
+  Log(options_.info_log, "Level-0 table #%llu: started (%d memtables)",
+      (unsigned long long) meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
@@ -445,8 +554,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
-
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -454,8 +561,18 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != NULL) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    if (pick_level) {
+      // Pick the level against the version this edit will be applied
+      // to, so wait out any descriptor update in progress.  The table
+      // may only leave level-0 while no compaction is running: that
+      // compaction's outputs could overlap it at a lower level.
+      while (manifest_writing_) {
+        bg_cv_.Wait();
+      }
+      if (!bg_compaction_scheduled_) {
+        level = versions_->current()->PickLevelForMemTableOutput(
+            min_user_key, max_user_key);
+      }
     }
     edit->AddFile(level, meta.number, meta.file_size,
                   meta.smallest, meta.largest);
@@ -465,42 +582,68 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
+  write_controller_.RecordCompaction(stats.bytes_written, stats.micros);
   return s;
 }
 
 Status DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(!imm_.empty());
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of all immutable memtables as a single new Table.
+  // More memtables may be retired while the mutex is released below;
+  // they are left for the next compaction.
+  const size_t n = imm_.size();
+  std::vector<MemTable*> mems;
+  for (size_t i = 0; i < n; i++) {
+    mems.push_back(imm_[i].mem);
+  }
   VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  uint64_t file_number;
+  Status s = WriteLevel0Table(mems, &edit, true, &file_number);
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace immutable memtables with the generated Table
   if (s.ok()) {
+    // Logs older than the one backing the oldest remaining memtable
+    // are no longer needed.
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    edit.SetLogNumber(imm_.size() > n ? imm_[n].log_number : logfile_number_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(file_number);
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
-    has_imm_.Release_Store(NULL);
+    for (size_t i = 0; i < n; i++) {
+      imm_[i].mem->Unref();
+    }
+    imm_.erase(imm_.begin(), imm_.begin() + n);
+    InstallSuperVersion();
     DeleteObsoleteFiles();
   }
 
   return s;
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_writing_) {
+    bg_cv_.Wait();
+  }
+  manifest_writing_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_writing_ = false;
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  bg_cv_.SignalAll();
+  return s;
+}
+
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   int max_level_with_files = 1;
   {
@@ -554,17 +697,15 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
 }
 
 Status DBImpl::TEST_CompactMemTable() {
-  MutexLock l(&mutex_);
-  LoggerId self;
-  AcquireLoggingResponsibility(&self);
-  Status s = MakeRoomForWrite(true /* force compaction */);
-  ReleaseLoggingResponsibility(&self);
+  // NULL batch means just wait for earlier writes to be done
+  Status s = Write(WriteOptions(), NULL);
   if (s.ok()) {
     // Wait until the compaction completes
-    while (imm_ != NULL && bg_error_.ok()) {
+    MutexLock l(&mutex_);
+    while (!imm_.empty() && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -573,12 +714,23 @@ Status DBImpl::TEST_CompactMemTable() {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
+  if (shutting_down_.Acquire_Load()) {
+    // DB is being deleted; no more background work
+    return;
+  }
+
+  // Memtable flushes get a thread of their own so that writers waiting
+  // on a full imm_ never queue behind a long compaction.
+  if (!imm_.empty() && !bg_flush_scheduled_) {
+    bg_flush_scheduled_ = true;
+    env_->ScheduleHighPriority(&DBImpl::BGFlushWork, this);
+  }
+
   if (bg_compaction_scheduled_) {
     // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
-    // DB is being deleted; no more background compactions
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
+  } else if (bg_compaction_paused_ > 0) {
+    // IngestExternalFiles() will reschedule when done
+  } else if (manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
@@ -605,12 +757,31 @@ void DBImpl::BackgroundCall() {
   bg_cv_.SignalAll();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(bg_flush_scheduled_);
+  if (!shutting_down_.Acquire_Load() && !imm_.empty()) {
+    CompactMemTable();
+  }
+  bg_flush_scheduled_ = false;
+
+  // The flush may have added enough level-0 files to need a compaction,
+  // and more memtables may have filled up while it ran.
+  MaybeScheduleCompaction();
+  bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+}
+
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
-    CompactMemTable();
-    return;
+  // A flush picks its output level against the current version; do not
+  // pick inputs from under it.
+  while (manifest_writing_) {
+    bg_cv_.Wait();
   }
 
   Compaction* c;
@@ -642,8 +813,8 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+                       f->smallest, f->largest, f->global_seqno);
+    status = LogAndApply(c->edit());
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
@@ -761,7 +932,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
-                                               current_bytes);
+                                               current_bytes,
+                                               0/*global_seqno*/);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -793,11 +965,9 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(
         level + 1,
         out.number, out.file_size, out.smallest, out.largest);
-    pending_outputs_.erase(out.number);
   }
-  compact->outputs.clear();
 
-  Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  Status s = LogAndApply(compact->compaction->edit());
   if (s.ok()) {
     compact->compaction->ReleaseInputs();
     DeleteObsoleteFiles();
@@ -812,7 +982,6 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
@@ -840,18 +1009,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
-    // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != NULL) {
-        CompactMemTable();
-        bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
-
     Slice key = input->key();
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != NULL) {
@@ -946,7 +1103,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   input = NULL;
 
   CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  stats.micros = env_->NowMicros() - start_micros;
   for (int which = 0; which < 2; which++) {
     for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
       stats.bytes_read += compact->compaction->input(which, i)->file_size;
@@ -958,6 +1115,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
   mutex_.Lock();
   stats_[compact->compaction->level() + 1].Add(stats);
+  write_controller_.RecordCompaction(stats.bytes_written, stats.micros);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -973,14 +1131,16 @@ struct IterState {
   port::Mutex* mu;
   Version* version;
   MemTable* mem;
-  MemTable* imm;
+  std::vector<MemTable*> imm;
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
   state->mem->Unref();
-  if (state->imm != NULL) state->imm->Unref();
+  for (size_t i = 0; i < state->imm.size(); i++) {
+    state->imm[i]->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -997,9 +1157,10 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   std::vector<Iterator*> list;
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    list.push_back(imm_[i].mem->NewIterator());
+    imm_[i].mem->Ref();
+    cleanup->imm.push_back(imm_[i].mem);
   }
   versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
@@ -1008,7 +1169,6 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   cleanup->mu = &mutex_;
   cleanup->mem = mem_;
-  cleanup->imm = imm_;
   cleanup->version = versions_->current();
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
@@ -1026,51 +1186,244 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+// Marks a ReadSlot whose cached reference has been claimed by a reader
+static char slot_in_use_marker;
+static void* const kSlotInUse = &slot_in_use_marker;
+
+// Readers that find the current SuperVersion in their slot report seek
+// statistics for one in this many of their lookups, so that charging a
+// seek does not take mutex_ on every Get().
+static const int kSeekSamplePeriod = 16;
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->mem->Ref();
+  for (size_t i = imm_.size(); i > 0; i--) {
+    sv->imm.push_back(imm_[i - 1].mem);  // Newest first
+    imm_[i - 1].mem->Ref();
+  }
+  sv->current = versions_->current();
+  sv->current->Ref();
+  sv->refs = 1;  // Held by super_version_
+
+  // Swap with a CompareAndSwap rather than a Release_Store: it is a full
+  // barrier, so the scan of the slots below cannot be reordered before
+  // it.  See ReturnSuperVersion().
+  SuperVersion* old = reinterpret_cast<SuperVersion*>(
+      super_version_.NoBarrier_Load());
+  super_version_.CompareAndSwap(old, sv);
+  PublishSequence();
+
+  // Drop the references cached in the slots.  Slots claimed by a reader
+  // are left alone; the reader notices the change when it returns them.
+  for (int i = 0; i < kNumReadSlots; i++) {
+    port::AtomicPointer* slot = &read_slots_[i].sv;
+    void* p = slot->Acquire_Load();
+    if (p != NULL && p != kSlotInUse && slot->CompareAndSwap(p, NULL)) {
+      UnrefSuperVersion(reinterpret_cast<SuperVersion*>(p));
+    }
+  }
+  if (old != NULL) {
+    UnrefSuperVersion(old);
+  }
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  assert(sv->refs > 0);
+  sv->refs--;
+  if (sv->refs == 0) {
+    sv->mem->Unref();
+    for (size_t i = 0; i < sv->imm.size(); i++) {
+      sv->imm[i]->Unref();
+    }
+    sv->current->Unref();
+    delete sv;
+  }
+}
+
+DBImpl::SuperVersion* DBImpl::GetSuperVersion(ReadSlot* slot,
+                                              bool* owns_slot) {
+  void* p = slot->sv.Acquire_Load();
+  *owns_slot = (p != NULL && p != kSlotInUse &&
+                slot->sv.CompareAndSwap(p, kSlotInUse));
+  if (*owns_slot && p == super_version_.Acquire_Load()) {
+    // Common case: the slot's reference is to the latest version
+    return reinterpret_cast<SuperVersion*>(p);
+  }
+
+  MutexLock l(&mutex_);
+  if (*owns_slot) {
+    // The cached reference is stale
+    UnrefSuperVersion(reinterpret_cast<SuperVersion*>(p));
+  }
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(
+      super_version_.NoBarrier_Load());
+  sv->refs++;
+  return sv;
+}
+
+void DBImpl::ReturnSuperVersion(ReadSlot* slot, bool owns_slot,
+                                SuperVersion* sv) {
+  // Cache our reference in the slot.  A slot that we did not claim is
+  // only filled if it is empty, since another reader may hold it.
+  if (slot->sv.CompareAndSwap(owns_slot ? kSlotInUse : NULL, sv)) {
+    // InstallSuperVersion() may have scanned the slots before our
+    // CompareAndSwap.  Both it and we issue a full barrier between
+    // writing one pointer and reading the other, so either it saw our
+    // reference and dropped it, or we see the new version here.
+    if (sv == super_version_.Acquire_Load() ||
+        !slot->sv.CompareAndSwap(sv, NULL)) {
+      return;
+    }
+  }
+  MutexLock l(&mutex_);
+  UnrefSuperVersion(sv);
+}
+
+void DBImpl::PublishSequence() {
+  mutex_.AssertHeld();
+  published_sequence_.Release_Store(reinterpret_cast<void*>(
+      static_cast<uintptr_t>(versions_->LastSequence())));
+}
+
+SequenceNumber DBImpl::PublishedSequence() {
+  if (sizeof(void*) >= sizeof(SequenceNumber)) {
+    return reinterpret_cast<uintptr_t>(published_sequence_.Acquire_Load());
+  }
+  // A sequence number does not fit in an AtomicPointer
+  MutexLock l(&mutex_);
+  return versions_->LastSequence();
+}
+
+DBImpl::ReadSlot* DBImpl::PickReadSlot() {
+  // Threads run on separate stacks, so the address of a local variable
+  // spreads concurrent readers over the slots.
+  char marker;
+  const uintptr_t stack_address = reinterpret_cast<uintptr_t>(&marker) >> 12;
+  return &read_slots_[Hash(reinterpret_cast<const char*>(&stack_address),
+                           sizeof(stack_address), 0) % kNumReadSlots];
+}
+
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
-  Status s;
-  MutexLock l(&mutex_);
+  ReadSlot* slot = PickReadSlot();
+  bool owns_slot;
+  SuperVersion* sv = GetSuperVersion(slot, &owns_slot);
+
+  // Take the snapshot after acquiring sv: any write with a sequence
+  // number up to the snapshot went to a memtable that sv includes, or
+  // raced with this call.
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
   } else {
-    snapshot = versions_->LastSequence();
+    snapshot = PublishedSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != NULL) imm->Ref();
-  current->Ref();
-
-  bool have_stat_update = false;
+  // First look in the memtable, then in the immutable memtables from
+  // newest to oldest.
+  Status s;
   Version::GetStats stats;
+  stats.seek_file = NULL;
+  LookupKey lkey(key, snapshot);
+  bool done = sv->mem->Get(lkey, value, &s);
+  for (size_t i = 0; !done && i < sv->imm.size(); i++) {
+    done = sv->imm[i]->Get(lkey, value, &s);
+  }
+  if (!done) {
+    s = sv->current->Get(options, lkey, value, &stats);
+  }
+
+  if (stats.seek_file != NULL) {
+    // Only readers that claimed their slot may count in it; the others
+    // are on the slow path anyway and report every seek.
+    int seeks = 1;
+    if (owns_slot) {
+      if (++slot->seek_samples < kSeekSamplePeriod) {
+        seeks = 0;
+      } else {
+        slot->seek_samples = 0;
+        seeks = kSeekSamplePeriod;
+      }
+    }
+    if (seeks > 0) {
+      MutexLock l(&mutex_);
+      if (sv->current->UpdateStats(stats, seeks)) {
+        MaybeScheduleCompaction();
+      }
+    }
+  }
+  ReturnSuperVersion(slot, owns_slot, sv);
+  return s;
+}
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
+namespace {
+// Orders indices into an array of user keys by key
+struct KeyIndexLess {
+  const Comparator* ucmp;
+  const Slice* keys;
+  bool operator()(int a, int b) const {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  }
+};
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const Slice* keys, int n,
+                      std::string* values, Status* statuses) {
+  if (n <= 0) {
+    return;
+  }
+  ReadSlot* slot = PickReadSlot();
+  bool owns_slot;
+  SuperVersion* sv = GetSuperVersion(slot, &owns_slot);
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = PublishedSequence();
+  }
+
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  KeyIndexLess less;
+  less.ucmp = user_comparator();
+  less.keys = keys;
+  std::stable_sort(order.begin(), order.end(), less);
+
+  // Keys the memtables do not settle go to the current version, in
+  // sorted order.
+  std::vector<Slice> version_keys;
+  std::vector<std::string*> version_values;
+  std::vector<Status*> version_statuses;
+  for (int j = 0; j < n; j++) {
+    const int i = order[j];
+    LookupKey lkey(keys[i], snapshot);
+    Status s;
+    bool done = sv->mem->Get(lkey, &values[i], &s);
+    for (size_t m = 0; !done && m < sv->imm.size(); m++) {
+      done = sv->imm[m]->Get(lkey, &values[i], &s);
+    }
+    if (done) {
+      statuses[i] = s;
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      version_keys.push_back(keys[i]);
+      version_values.push_back(&values[i]);
+      version_statuses.push_back(&statuses[i]);
     }
-    mutex_.Lock();
   }
-
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (!version_keys.empty()) {
+    sv->current->MultiGet(options, snapshot, version_keys.size(),
+                          &version_keys[0], &version_values[0],
+                          &version_statuses[0]);
   }
-  mem->Unref();
-  if (imm != NULL) imm->Unref();
-  current->Unref();
-  return s;
+  ReturnSuperVersion(slot, owns_slot, sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
@@ -1080,7 +1433,8 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
       &dbname_, env_, user_comparator(), internal_iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
-       : latest_snapshot));
+       : latest_snapshot),
+      options.prefix_same_as_start ? options_.prefix_extractor : NULL);
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1102,89 +1456,271 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
-// There is at most one thread that is the current logger.  This call
-// waits until preceding logger(s) have finished and becomes the
-// current logger.
-void DBImpl::AcquireLoggingResponsibility(LoggerId* self) {
-  while (logger_ != NULL) {
-    logger_cv_.Wait();
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  Writer w(&mutex_);
+  w.batch = my_batch;
+  w.sync = options.sync;
+  w.disable_wal = options.disable_wal;
+  w.done = false;
+  if (options.sync && options.disable_wal) {
+    return Status::InvalidArgument("sync write requires the log");
   }
-  logger_ = self;
-}
-
-void DBImpl::ReleaseLoggingResponsibility(LoggerId* self) {
-  assert(logger_ == self);
-  logger_ = NULL;
-  logger_cv_.SignalAll();
-}
 
-Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
-  Status status;
   MutexLock l(&mutex_);
-  LoggerId self;
-  AcquireLoggingResponsibility(&self);
-  status = MakeRoomForWrite(false);  // May temporarily release lock and wait
-  uint64_t last_sequence = versions_->LastSequence();
-  if (status.ok()) {
+  writers_.push_back(&w);
+  while (!w.done) {
+    if (w.insert_leader != NULL) {
+      // Our batch has been logged by the group leader; apply it to the
+      // memtable in parallel with the other members of the group.
+      InsertAsGroupMember(&w);
+    } else if (!writers_.empty() && &w == writers_.front()) {
+      break;
+    } else {
+      w.cv.Wait();
+    }
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(my_batch == NULL);
+  Writer* last_writer = &w;
+  WriteBatch scratch;
+  WriteBatch* updates = NULL;
+  if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
+    updates = BuildBatchGroup(&last_writer, &scratch);
+
+    // Once level-0 starts backing up, pace writes to the rate at which
+    // compactions can drain them instead of letting level-0 grow until
+    // writes stop outright.
+    write_controller_.Update(versions_->NumLevelFiles(0));
+    const uint64_t delay = write_controller_.GetDelay(
+        env_->NowMicros(), WriteBatchInternal::ByteSize(updates));
+    if (delay > 0) {
+      mutex_.Unlock();
+      env_->SleepForMicroseconds(static_cast<int>(delay));
+      mutex_.Lock();
+    }
+
+    // Sequence numbers are handed out in log order.  Groups that are
+    // still waiting to be applied to the memtable have not published
+    // their sequence numbers yet, so continue after the newest of them.
+    uint64_t last_sequence = (memtable_writers_.empty()
+                              ? versions_->LastSequence()
+                              : memtable_writers_.back()->last_sequence);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
+    w.last_sequence = last_sequence;
 
-    // Add to log and apply to memtable.  We can release the lock during
-    // this phase since the "logger_" flag protects against concurrent
-    // loggers and concurrent writes into mem_.
-    {
-      assert(logger_ == &self);
+    // Add to log.  We can release the lock during this phase since &w
+    // is currently responsible for logging and protects against
+    // concurrent loggers.  Groups that skip the log still pass through
+    // here so that sequence numbers stay in order.
+    if (!w.disable_wal) {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(updates));
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
       }
+      mutex_.Lock();
+    }
+  }
+
+  // Remove this group from the log queue and let the next group start
+  // logging while we apply our records to the memtable.
+  std::vector<Writer*> followers;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (status.ok() && updates != NULL) {
+    // Apply to the memtable in the same order the groups were logged.
+    // Only one group inserts at a time since the skiplist requires
+    // external synchronization for writes.
+    memtable_writers_.push_back(&w);
+    while (&w != memtable_writers_.front()) {
+      w.cv.Wait();
+    }
+    MemTable* mem = mem_;
+    if (updates == &scratch && options_.allow_concurrent_memtable_write) {
+      // Hand each member its own slice of the group's sequence numbers
+      // and let it insert its batch while we insert ours.
+      SequenceNumber seq = WriteBatchInternal::Sequence(updates);
+      WriteBatchInternal::SetSequence(my_batch, seq);
+      seq += WriteBatchInternal::Count(my_batch);
+      for (size_t i = 0; i < followers.size(); i++) {
+        Writer* member = followers[i];
+        if (member->batch != NULL) {
+          WriteBatchInternal::SetSequence(member->batch, seq);
+          seq += WriteBatchInternal::Count(member->batch);
+          member->insert_leader = &w;
+          w.pending_inserts++;
+          member->cv.Signal();
+        }
+      }
+      assert(seq == w.last_sequence + 1);
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertConcurrentlyInto(my_batch, mem);
+      mutex_.Lock();
+      while (w.pending_inserts > 0) {
+        w.cv.Wait();
+      }
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+        status = w.insert_status;
       }
+    } else {
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertInto(updates, mem);
       mutex_.Lock();
-      assert(logger_ == &self);
     }
 
-    versions_->SetLastSequence(last_sequence);
+    // Publish our sequence numbers.  All earlier groups have already
+    // published theirs, so readers never observe a gap.
+    versions_->SetLastSequence(w.last_sequence);
+    PublishSequence();
+    memtable_writers_.pop_front();
+    if (!memtable_writers_.empty()) {
+      memtable_writers_.front()->cv.Signal();
+    } else {
+      bg_cv_.SignalAll();  // MakeRoomForWrite() may be waiting for us
+    }
+  }
+
+  for (size_t i = 0; i < followers.size(); i++) {
+    Writer* ready = followers[i];
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
   }
-  ReleaseLoggingResponsibility(&self);
+
   return status;
 }
 
+// REQUIRES: mutex_ is held and w->insert_leader is set
+void DBImpl::InsertAsGroupMember(Writer* w) {
+  mutex_.AssertHeld();
+  Writer* leader = w->insert_leader;
+  // The leader is at the front of memtable_writers_, so mem_ is stable.
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertConcurrentlyInto(w->batch, mem);
+  mutex_.Lock();
+  w->insert_leader = NULL;
+  if (!s.ok() && leader->insert_status.ok()) {
+    leader->insert_status = s;
+  }
+  if (--leader->pending_inserts == 0) {
+    leader->cv.Signal();
+  }
+}
+
+// REQUIRES: Writer list must be non-empty
+// REQUIRES: First writer must have a non-NULL batch
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* scratch) {
+  assert(!writers_.empty());
+  Writer* first = writers_.front();
+  WriteBatch* result = first->batch;
+  assert(result != NULL);
+
+  size_t size = WriteBatchInternal::ByteSize(first->batch);
+
+  // Allow the group to grow up to a maximum size, but if the
+  // original write is small, limit the growth so we do not slow
+  // down the small write too much.
+  size_t max_size = 1 << 20;
+  if (size <= (128<<10)) {
+    max_size = size + (128<<10);
+  }
+
+  *last_writer = first;
+  std::deque<Writer*>::iterator iter = writers_.begin();
+  ++iter;  // Advance past "first"
+  for (; iter != writers_.end(); ++iter) {
+    Writer* w = *iter;
+    if (w->sync && !first->sync) {
+      // Do not include a sync write into a batch handled by a non-sync write.
+      break;
+    }
+
+    if (w->disable_wal != first->disable_wal) {
+      // Every write in a group is either logged or not.
+      break;
+    }
+
+    if (w->batch == NULL) {
+      // Memtable switches and file ingestion must run on their own.
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to scratch batch instead of disturbing caller's batch
+      result = scratch;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
+    }
+    WriteBatchInternal::Append(result, w->batch);
+    *last_writer = w;
+  }
+  return result;
+}
+
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** file) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, number);
+  if (log_recycle_files_.empty()) {
+    return env_->NewWritableFile(fname, file);
+  }
+  const uint64_t old_number = log_recycle_files_.front();
+  log_recycle_files_.pop_front();
+  Log(options_.info_log, "Recycling log #%llu as #%llu\n",
+      static_cast<unsigned long long>(old_number),
+      static_cast<unsigned long long>(number));
+  return env_->ReuseWritableFile(fname, LogFileName(dbname_, old_number), file);
+}
+
 // REQUIRES: mutex_ is held
-// REQUIRES: this thread is the current logger
+// REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
-  assert(logger_ != NULL);
-  bool allow_delay = !force;
+  assert(!writers_.empty());
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != NULL) {
-      // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+    } else if (!memtable_writers_.empty()) {
+      // Earlier groups are still being applied to the current memtable;
+      // wait for them to finish before switching it out.
+      bg_cv_.Wait();
+    } else if (static_cast<int>(imm_.size()) + 1 >=
+               options_.max_write_buffer_number) {
+      // We have filled up the current memtable, and the earlier ones
+      // are all still waiting to be compacted, so we wait.
+      const uint64_t start_micros = env_->NowMicros();
       bg_cv_.Wait();
+      flush_wait_micros_ += env_->NowMicros() - start_micros;
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "waiting...\n");
@@ -1194,19 +1730,23 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = NewLogFile(new_log_number, &lfile);
       if (!s.ok()) {
         break;
       }
       delete log_;
       delete logfile_;
       logfile_ = lfile;
+      ImmutableMemTable retired;
+      retired.mem = mem_;
+      retired.log_number = logfile_number_;
+      imm_.push_back(retired);
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
+      log_ = new log::Writer(lfile, new_log_number,
+                             first_recyclable_log_ != 0);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1214,6 +1754,285 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+namespace {
+// A table handed to IngestExternalFiles()
+struct ExternalFile {
+  std::string path;
+  uint64_t file_size;
+  std::string smallest;     // Smallest user key in the table
+  std::string largest;      // Largest user key in the table
+  uint64_t number;          // File number assigned in the DB
+  bool moved;               // Was the file renamed into the DB?
+};
+
+struct ExternalFileOrder {
+  const Comparator* ucmp;
+  explicit ExternalFileOrder(const Comparator* c) : ucmp(c) { }
+  bool operator()(const ExternalFile& a, const ExternalFile& b) const {
+    return ucmp->Compare(a.smallest, b.smallest) < 0;
+  }
+};
+
+// Check that the table in f->path is readable, non-empty and holds
+// strictly increasing user keys, and record its size and key range.
+static Status ScanExternalFile(Env* env, const Options& options,
+                               ExternalFile* f) {
+  Status s = env->GetFileSize(f->path, &f->file_size);
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(f->path, &file);
+  }
+  if (s.ok()) {
+    s = Table::Open(options, file, f->file_size, &table);
+  }
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    bool empty = true;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (!empty && options.comparator->Compare(iter->key(), f->largest) <= 0) {
+        s = Status::InvalidArgument(f->path,
+                                    "keys are not strictly increasing");
+        break;
+      }
+      if (empty) {
+        f->smallest = iter->key().ToString();
+        empty = false;
+      }
+      f->largest = iter->key().ToString();
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    if (s.ok() && empty) {
+      s = Status::InvalidArgument(f->path, "table is empty");
+    }
+    delete iter;
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete[] buffer;
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->DeleteFile(dst);
+  }
+  return s;
+}
+}  // namespace
+
+bool DBImpl::MemTablesOverlap(const Slice& smallest, const Slice& largest) {
+  mutex_.AssertHeld();
+  std::vector<MemTable*> mems;
+  mems.push_back(mem_);
+  for (size_t i = 0; i < imm_.size(); i++) {
+    mems.push_back(imm_[i].mem);
+  }
+  LookupKey start(smallest, kMaxSequenceNumber);
+  bool overlap = false;
+  for (size_t i = 0; i < mems.size() && !overlap; i++) {
+    Iterator* iter = mems[i]->NewIterator();
+    iter->Seek(start.internal_key());
+    overlap = (iter->Valid() &&
+               user_comparator()->Compare(ExtractUserKey(iter->key()),
+                                          largest) <= 0);
+    delete iter;
+  }
+  return overlap;
+}
+
+Status DBImpl::IngestExternalFiles(const std::vector<std::string>& files) {
+  // Validate the files before touching the DB.  They hold plain user
+  // keys, so read them with the user comparator.
+  Options table_options = options_;
+  table_options.comparator = user_comparator();
+  table_options.filter_policy = internal_filter_policy_.user_policy();
+  table_options.prefix_extractor = NULL;
+  std::vector<ExternalFile> tables(files.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    tables[i].path = files[i];
+    tables[i].moved = false;
+    s = ScanExternalFile(env_, table_options, &tables[i]);
+  }
+  if (!s.ok() || tables.empty()) {
+    return s;
+  }
+  std::sort(tables.begin(), tables.end(),
+            ExternalFileOrder(user_comparator()));
+  for (size_t i = 1; i < tables.size(); i++) {
+    if (user_comparator()->Compare(tables[i-1].largest,
+                                   tables[i].smallest) >= 0) {
+      return Status::InvalidArgument("overlapping key ranges",
+                                     tables[i].path);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < tables.size(); i++) {
+    tables[i].number = versions_->NewFileNumber();
+    pending_outputs_.insert(tables[i].number);
+  }
+
+  // Move the files into the DB under temporary numbers; they get their
+  // final ones once the writer queue is ours.
+  mutex_.Unlock();
+  for (size_t i = 0; i < tables.size() && s.ok(); i++) {
+    const std::string fname = TableFileName(dbname_, tables[i].number);
+    if (env_->RenameFile(tables[i].path, fname).ok()) {
+      tables[i].moved = true;
+    } else {
+      // Perhaps the file lives on another file system
+      s = CopyFile(env_, tables[i].path, fname);
+    }
+  }
+  mutex_.Lock();
+
+  // Occupy the front of the writer queue so that no writes happen while
+  // the files are installed, and wait for earlier groups to finish
+  // their memtable inserts.
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.disable_wal = false;
+  w.done = false;
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_writers_.empty()) {
+    bg_cv_.Wait();
+  }
+
+  // The ingested data is newer than anything in the memtables, which
+  // are searched before any table, so overlapping memtables have to be
+  // flushed first.
+  bool overlap = false;
+  for (size_t i = 0; i < tables.size() && !overlap; i++) {
+    overlap = MemTablesOverlap(tables[i].smallest, tables[i].largest);
+  }
+  if (s.ok() && overlap) {
+    s = MakeRoomForWrite(true /* force memtable switch */);
+    while (s.ok() && !imm_.empty() && bg_error_.ok()) {
+      bg_cv_.Wait();
+    }
+    if (s.ok()) {
+      s = bg_error_;
+    }
+  }
+
+  if (s.ok()) {
+    // A running compaction could write output overlapping the files at
+    // the levels picked for them, so let it finish and keep others from
+    // starting until the new version is installed.
+    bg_compaction_paused_++;
+    while (bg_compaction_scheduled_ || manifest_writing_) {
+      bg_cv_.Wait();
+    }
+
+    // Level-0 files are searched newest first by file number, so the
+    // files have to be renumbered after the tables holding older data
+    // for their keys, such as the flush above.
+    std::vector<uint64_t> numbers(tables.size());
+    for (size_t i = 0; i < tables.size(); i++) {
+      numbers[i] = versions_->NewFileNumber();
+      pending_outputs_.insert(numbers[i]);
+    }
+    mutex_.Unlock();
+    size_t renamed = 0;
+    while (renamed < tables.size() && s.ok()) {
+      s = env_->RenameFile(TableFileName(dbname_, tables[renamed].number),
+                           TableFileName(dbname_, numbers[renamed]));
+      if (s.ok()) {
+        renamed++;
+      }
+    }
+    mutex_.Lock();
+    for (size_t i = 0; i < tables.size(); i++) {
+      if (i < renamed) {
+        pending_outputs_.erase(tables[i].number);
+        tables[i].number = numbers[i];
+      } else {
+        pending_outputs_.erase(numbers[i]);
+      }
+    }
+
+    if (s.ok()) {
+      const SequenceNumber seqno = versions_->LastSequence() + 1;
+      Version* base = versions_->current();
+      VersionEdit edit;
+      for (size_t i = 0; i < tables.size(); i++) {
+        const ExternalFile& t = tables[i];
+        const int level = base->PickLevelForExternalFile(t.smallest, t.largest);
+        edit.AddFile(level, t.number, t.file_size,
+                     InternalKey(t.smallest, seqno, kTypeValue),
+                     InternalKey(t.largest, seqno, kTypeValue),
+                     seqno);
+        Log(options_.info_log, "Ingested table #%llu at level-%d: %s",
+            static_cast<unsigned long long>(t.number), level, t.path.c_str());
+      }
+      versions_->SetLastSequence(seqno);
+      s = LogAndApply(&edit);
+    }
+    bg_compaction_paused_--;
+  }
+
+  for (size_t i = 0; i < tables.size(); i++) {
+    pending_outputs_.erase(tables[i].number);
+    if (!s.ok()) {
+      // Give the caller its files back
+      const std::string fname = TableFileName(dbname_, tables[i].number);
+      if (tables[i].moved) {
+        env_->RenameFile(fname, tables[i].path);
+      } else {
+        env_->DeleteFile(fname);
+      }
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  MaybeScheduleCompaction();
+  return s;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1259,6 +2078,21 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
         value->append(buf);
       }
     }
+    snprintf(buf, sizeof(buf),
+             "Write delay: %.3f sec; compaction rate %.1f MB/s%s\n",
+             write_controller_.total_delay_micros() / 1e6,
+             write_controller_.compaction_rate() / 1048576.0,
+             write_controller_.IsDelayed() ? " (delaying writes)" : "");
+    value->append(buf);
+    snprintf(buf, sizeof(buf), "Flush wait: %.3f sec%s\n",
+             flush_wait_micros_ / 1e6,
+             bg_flush_scheduled_ ? " (flushing)" : "");
+    value->append(buf);
+    return true;
+  } else if (in == "num-immutable-mem-table") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%d", static_cast<int>(imm_.size()));
+    *value = buf;
     return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
@@ -1321,14 +2155,17 @@ Status DB::Open(const Options& options, const std::string& dbname,
   if (s.ok()) {
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number, &lfile);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+      if (impl->options_.recycle_log_file_num > 0) {
+        impl->first_recyclable_log_ = new_log_number;
+      }
+      impl->log_ = new log::Writer(lfile, new_log_number,
+                                   impl->first_recyclable_log_ != 0);
+      s = impl->LogAndApply(&edit);
     }
     if (s.ok()) {
       impl->DeleteObsoleteFiles();
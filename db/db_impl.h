@@ -5,10 +5,12 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <deque>
 #include <set>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -33,12 +35,16 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        const Slice* keys, int n,
+                        std::string* values, Status* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -59,6 +65,9 @@ class DBImpl : public DB {
 
  private:
   friend class DB;
+  struct Writer;
+  struct SuperVersion;
+  struct ReadSlot;
 
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot);
@@ -73,6 +82,7 @@ class DBImpl : public DB {
   void MaybeIgnoreError(Status* s) const;
 
   // Delete any unneeded files and stale in-memory entries.
+  // REQUIRES: mutex_ is held; it is released while tables are deleted.
   void DeleteObsoleteFiles();
 
   // Compact the in-memory write buffer to disk.  Switches to a new
@@ -83,20 +93,59 @@ class DBImpl : public DB {
                         VersionEdit* edit,
                         SequenceNumber* max_sequence);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base);
+  // Write the union of "mems" to a single new table.  If "pick_level"
+  // is true the table may be placed below level-0 when nothing there
+  // overlaps it.  The table's number is stored in *file_number and left
+  // in pending_outputs_; the caller removes it once *edit is applied.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, bool pick_level,
+                          uint64_t* file_number);
 
-  // Only thread is allowed to log at a time.
-  struct LoggerId { };          // Opaque identifier for logging thread
-  void AcquireLoggingResponsibility(LoggerId* self);
-  void ReleaseLoggingResponsibility(LoggerId* self);
+  // Apply *edit to the current version.  Unlike VersionSet::LogAndApply()
+  // this may be called concurrently by the flush and compaction threads;
+  // the calls are applied one at a time.
+  Status LogAndApply(VersionEdit* edit);
+
+  // Create the file for log "number", reusing a log file kept in
+  // log_recycle_files_ if there is one.
+  Status NewLogFile(uint64_t number, WritableFile** file);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */);
 
+  // Make the current mem_, imm_ and Version visible to Get() and drop
+  // the references cached in read_slots_ to the previous ones.
+  // REQUIRES: mutex_ is held
+  void InstallSuperVersion();
+  void UnrefSuperVersion(SuperVersion* sv);
+
+  // Return a referenced SuperVersion for Get(), taking it from "slot"
+  // without locking mutex_ when possible.  Sets *owns_slot if the slot
+  // was claimed; ReturnSuperVersion() must then be given the same slot.
+  // REQUIRES: mutex_ is not held
+  SuperVersion* GetSuperVersion(ReadSlot* slot, bool* owns_slot);
+  void ReturnSuperVersion(ReadSlot* slot, bool owns_slot, SuperVersion* sv);
+
+  // Return the read slot for the calling thread.
+  ReadSlot* PickReadSlot();
+
+  // Make versions_->LastSequence() visible to Get().
+  // REQUIRES: mutex_ is held
+  void PublishSequence();
+  SequenceNumber PublishedSequence();
+
+  // Returns true iff mem_ or one of imm_ holds a key in the user key
+  // range [smallest,largest].
+  bool MemTablesOverlap(const Slice& smallest, const Slice& largest);
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch);
+  void InsertAsGroupMember(Writer* w);
+
   struct CompactionState;
 
   void MaybeScheduleCompaction();
   static void BGWork(void* db);
   void BackgroundCall();
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
   void BackgroundCompaction();
   void CleanupCompaction(CompactionState* compact);
   Status DoCompactionWork(CompactionState* compact);
@@ -108,6 +157,8 @@ class DBImpl : public DB {
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
+  const InternalFilterPolicy internal_filter_policy_;
+  const InternalPrefixExtractor internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
@@ -124,15 +175,70 @@ class DBImpl : public DB {
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
   MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+
+  // Full memtables waiting to be compacted, oldest first.  Holds at most
+  // options_.max_write_buffer_number - 1 entries.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t log_number;  // Log file holding the updates in "mem"
+  };
+  std::vector<ImmutableMemTable> imm_;
+
+  // A snapshot of mem_, imm_ and the current Version, each referenced,
+  // so that Get() can read them without holding mutex_.  refs is only
+  // changed while mutex_ is held.
+  struct SuperVersion {
+    MemTable* mem;
+    std::vector<MemTable*> imm;   // Newest first
+    Version* current;
+    int refs;
+  };
+
+  // The latest SuperVersion.  Only replaced while mutex_ is held, but
+  // Get() loads it without the lock to check whether a cached reference
+  // is still current.
+  port::AtomicPointer super_version_;
+
+  // Each slot caches one reference to a SuperVersion.  Get() claims the
+  // cached reference by swapping in kSlotInUse, so readers that land on
+  // different slots share no lock and no reference count.  Readers
+  // pick a slot by the address of their stack.
+  struct ReadSlot {
+    port::AtomicPointer sv;       // NULL, kSlotInUse or a SuperVersion*
+    int seek_samples;             // Only touched by the slot's claimant
+    char padding[64];             // Keep slots on separate cache lines
+  };
+  enum { kNumReadSlots = 32 };
+  ReadSlot read_slots_[kNumReadSlots];
+
+  // versions_->LastSequence() as of the last completed write, for Get()
+  // to read without holding mutex_.
+  port::AtomicPointer published_sequence_;
+
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
-  LoggerId* logger_;            // NULL, or the id of the current logging thread
-  port::CondVar logger_cv_;     // For threads waiting to log
+
+  // Number of the first log this DBImpl wrote in the recyclable format,
+  // or 0.  Only such logs are safe to reuse: recovery can tell their
+  // records apart from whatever a later log leaves behind in the file.
+  uint64_t first_recyclable_log_;
+
+  // Obsolete log files kept for reuse by NewLogFile(), oldest first.
+  std::deque<uint64_t> log_recycle_files_;
+
+  // Queue of writers waiting to append to the log.
+  std::deque<Writer*> writers_;
+
+  // Group leaders whose records are in the log but not yet in mem_, in
+  // log order.  mem_ is not switched while this queue is non-empty.
+  std::deque<Writer*> memtable_writers_;
+
   SnapshotList snapshots_;
 
+  // Paces writes when compactions fall behind
+  WriteController write_controller_;
+
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
@@ -140,6 +246,17 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Has a memtable flush been scheduled or is running?  Flushes run on
+  // the Env's high-priority thread, separately from compactions.
+  bool bg_flush_scheduled_;
+
+  // Is a LogAndApply() call in progress?
+  bool manifest_writing_;
+
+  // While positive no background compaction is scheduled.  Set while
+  // IngestExternalFiles() installs its files.
+  int bg_compaction_paused_;
+
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
@@ -172,6 +289,9 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Total time writers spent waiting for a memtable flush to finish
+  uint64_t flush_wait_micros_;
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
@@ -185,6 +305,8 @@ class DBImpl : public DB {
 // it is not equal to src.info_log.
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
+                               const InternalFilterPolicy* ipolicy,
+                               const InternalPrefixExtractor* iprefix,
                                const Options& src);
 
 }  // namespace leveldb
@@ -47,14 +47,17 @@ class DBIter: public Iterator {
   };
 
   DBIter(const std::string* dbname, Env* env,
-         const Comparator* cmp, Iterator* iter, SequenceNumber s)
+         const Comparator* cmp, Iterator* iter, SequenceNumber s,
+         const PrefixExtractor* prefix_extractor)
       : dbname_(dbname),
         env_(env),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
         direction_(kForward),
-        valid_(false) {
+        valid_(false),
+        has_prefix_(false) {
   }
   virtual ~DBIter() {
     delete iter_;
@@ -86,6 +89,18 @@ class DBIter: public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  void PrefixNotSupported(const char* operation);
+
+  // Does the internal iterator's current key lie past the prefix that
+  // iteration is bounded to?
+  inline bool PastPrefix() const {
+    if (!has_prefix_) {
+      return false;
+    }
+    const Slice k = iter_->key();
+    return (!prefix_extractor_->InDomain(k) ||
+            prefix_extractor_->Transform(k) != Slice(prefix_));
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -105,12 +120,15 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const PrefixExtractor* const prefix_extractor_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool has_prefix_;           // Is iteration bounded to prefix_?
+  std::string prefix_;
 
   // No copying allowed
   DBIter(const DBIter&);
@@ -157,6 +175,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(iter_->Valid());
   assert(direction_ == kForward);
   do {
+    if (PastPrefix()) {
+      break;
+    }
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
@@ -184,8 +205,20 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::PrefixNotSupported(const char* operation) {
+  valid_ = false;
+  saved_key_.clear();
+  ClearSavedValue();
+  status_ = Status::NotSupported(operation,
+                                 "iterator is bounded to a key prefix");
+}
+
 void DBIter::Prev() {
   assert(valid_);
+  if (prefix_extractor_ != NULL) {
+    PrefixNotSupported("Prev()");
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
@@ -259,6 +292,12 @@ void DBIter::Seek(const Slice& target) {
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+  has_prefix_ = (prefix_extractor_ != NULL &&
+                 prefix_extractor_->InDomain(saved_key_));
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(saved_key_);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -268,6 +307,10 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  if (prefix_extractor_ != NULL) {
+    PrefixNotSupported("SeekToFirst()");
+    return;
+  }
   direction_ = kForward;
   ClearSavedValue();
   iter_->SeekToFirst();
@@ -279,6 +322,10 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  if (prefix_extractor_ != NULL) {
+    PrefixNotSupported("SeekToLast()");
+    return;
+  }
   direction_ = kReverse;
   ClearSavedValue();
   iter_->SeekToLast();
@@ -292,8 +339,10 @@ Iterator* NewDBIterator(
     Env* env,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
-    const SequenceNumber& sequence) {
-  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence);
+    const SequenceNumber& sequence,
+    const PrefixExtractor* prefix_extractor) {
+  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence,
+                    prefix_extractor);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,17 @@ namespace leveldb {
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "prefix_extractor" (which applies to
+// internal keys) is non-NULL, the iterator stops at the first key whose
+// prefix differs from that of the target of the last Seek(), and only
+// supports Seek() and Next().
 extern Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
-    const SequenceNumber& sequence);
+    const SequenceNumber& sequence,
+    const PrefixExtractor* prefix_extractor);
 
 }  // namespace leveldb
 
@@ -5,10 +5,15 @@
 #include "leveldb/db.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
+#include "db/snapshot.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/prefix_extractor.h"
 #include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/testharness.h"
@@ -28,8 +33,52 @@ class SpecialEnv : public EnvWrapper {
   // sstable Sync() calls are blocked while this pointer is non-NULL.
   port::AtomicPointer delay_sstable_sync_;
 
-  explicit SpecialEnv(Env* base) : EnvWrapper(base) {
+  // Reads from files opened by NewRandomAccessFile() are counted in
+  // random_read_counter_ while this pointer is non-NULL.
+  port::AtomicPointer count_random_reads_;
+  port::Mutex random_read_mu_;
+  int random_read_counter_;
+
+  explicit SpecialEnv(Env* base) : EnvWrapper(base), random_read_counter_(0) {
     delay_sstable_sync_.Release_Store(NULL);
+    count_random_reads_.Release_Store(NULL);
+  }
+
+  int RandomReads() {
+    MutexLock l(&random_read_mu_);
+    return random_read_counter_;
+  }
+
+  void ResetRandomReads() {
+    MutexLock l(&random_read_mu_);
+    random_read_counter_ = 0;
+  }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    class CountingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+      SpecialEnv* env_;
+     public:
+      CountingFile(RandomAccessFile* target, SpecialEnv* env)
+          : target_(target), env_(env) {
+      }
+      virtual ~CountingFile() { delete target_; }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        if (env_->count_random_reads_.Acquire_Load() != NULL) {
+          MutexLock l(&env_->random_read_mu_);
+          env_->random_read_counter_++;
+        }
+        return target_->Read(offset, n, result, scratch);
+      }
+    };
+
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok()) {
+      *r = new CountingFile(*r, this);
+    }
+    return s;
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -136,6 +185,37 @@ class DBTest {
     return result;
   }
 
+  // Return the results of looking up "keys" with MultiGet() and with
+  // Get() as two strings formatted like "v1,NOT_FOUND,v2".
+  void MultiGetAndGet(const std::vector<std::string>& keys,
+                      const Snapshot* snapshot,
+                      std::string* multi_get_result,
+                      std::string* get_result) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    const int n = keys.size();
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values(n);
+    std::vector<Status> statuses(n);
+    db_->MultiGet(options, &key_slices[0], n, &values[0], &statuses[0]);
+    multi_get_result->clear();
+    get_result->clear();
+    for (int i = 0; i < n; i++) {
+      if (i > 0) {
+        multi_get_result->push_back(',');
+        get_result->push_back(',');
+      }
+      if (statuses[i].ok()) {
+        multi_get_result->append(values[i]);
+      } else if (statuses[i].IsNotFound()) {
+        multi_get_result->append("NOT_FOUND");
+      } else {
+        multi_get_result->append(statuses[i].ToString());
+      }
+      get_result->append(Get(keys[i], snapshot));
+    }
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -428,6 +508,33 @@ TEST(DBTest, GetEncountersEmptyLevel) {
   }
 }
 
+TEST(DBTest, GetDoesNotPinObsoleteFiles) {
+  // Get() caches references to the version it read from; compacting
+  // the files away afterwards must still delete them.
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("z", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v2", Get("a"));
+  ASSERT_EQ("v1", Get("z"));
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, TotalTableFiles());
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  int tables = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+      tables++;
+    }
+  }
+  ASSERT_EQ(1, tables);
+  ASSERT_EQ("v2", Get("a"));
+}
+
 TEST(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -668,6 +775,125 @@ TEST(DBTest, RecoverDuringMemtableCompaction) {
   ASSERT_EQ(std::string(1000, 'y'), Get("big2"));
 }
 
+// Check that writes keep flowing into new memtables while an earlier
+// memtable compaction is stuck, and that the pile of immutable memtables
+// is visible to reads and survives a reopen.
+TEST(DBTest, MultipleImmutableMemtables) {
+  Options options;
+  options.env = env_;
+  options.write_buffer_size = 100000;
+  options.max_write_buffer_number = 4;
+  Reopen(&options);
+
+  env_->delay_sstable_sync_.Release_Store(env_);  // Block memtable flushes
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("big1", std::string(200000, '1')));  // Fills memtable
+  ASSERT_OK(Put("big2", std::string(200000, '2')));  // Retires 1st memtable
+  ASSERT_OK(Put("big3", std::string(200000, '3')));  // Retires 2nd memtable
+  ASSERT_OK(Put("foo", "v2"));                       // Retires 3rd memtable
+  std::string num;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+  ASSERT_NE("0", num);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(std::string(200000, '1'), Get("big1"));
+  ASSERT_EQ(std::string(200000, '3'), Get("big3"));
+  ASSERT_EQ("[ v2, v1 ]", AllEntriesFor("foo"));
+
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+  ASSERT_EQ("0", num);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(std::string(200000, '2'), Get("big2"));
+
+  Reopen(&options);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(std::string(200000, '1'), Get("big1"));
+  ASSERT_EQ(std::string(200000, '2'), Get("big2"));
+  ASSERT_EQ(std::string(200000, '3'), Get("big3"));
+}
+
+TEST(DBTest, DisableWAL) {
+  Options options;
+  Reopen(&options);
+  WriteOptions no_wal;
+  no_wal.disable_wal = true;
+
+  ASSERT_OK(db_->Put(no_wal, "foo", "v1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "bar", "v2"));
+  ASSERT_OK(db_->Put(no_wal, "baz", "v3"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v3", Get("baz"));
+  ASSERT_EQ("[ v2 ]", AllEntriesFor("bar"));
+
+  // Unlogged writes that were never compacted are lost on reopen;
+  // logged writes survive.
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ("NOT_FOUND", Get("baz"));
+
+  // Once the memtable holding them is compacted they are durable, and
+  // later writes still get fresh sequence numbers.
+  ASSERT_OK(db_->Put(no_wal, "foo", "v4"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  Reopen(&options);
+  ASSERT_EQ("v4", Get("foo"));
+  ASSERT_OK(Put("foo", "v5"));
+  ASSERT_EQ("v5", Get("foo"));
+  Reopen(&options);
+  ASSERT_EQ("v5", Get("foo"));
+
+  // The log cannot be both skipped and synced.
+  WriteOptions bad;
+  bad.sync = true;
+  bad.disable_wal = true;
+  Status s = db_->Put(bad, "foo", "v6");
+  ASSERT_TRUE(Slice(s.ToString()).starts_with("Invalid argument"))
+      << s.ToString();
+  ASSERT_EQ("v5", Get("foo"));
+}
+
+TEST(DBTest, RecycleLogFiles) {
+  Options options;
+  options.env = Env::Default();  // SpecialEnv would hide file reuse
+  options.paranoid_checks = true;
+  options.recycle_log_file_num = 2;
+  Reopen(&options);
+
+  // Each round switches to a new log; the old ones are reused, so their
+  // tails still hold records of earlier logs that recovery must ignore.
+  for (int i = 0; i < 10; i++) {
+    for (int j = 10 - i; j > 0; j--) {
+      ASSERT_OK(Put("k" + NumberToString(j), std::string(1000, 'a' + i)));
+    }
+    ASSERT_OK(Put("foo", "v" + NumberToString(i)));
+    if (i < 9) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    int logs = 0;
+    for (size_t k = 0; k < filenames.size(); k++) {
+      if (ParseFileName(filenames[k], &number, &type) && type == kLogFile) {
+        logs++;
+      }
+    }
+    ASSERT_LE(logs, 1 + options.recycle_log_file_num);
+  }
+
+  Reopen(&options);
+  ASSERT_EQ("v9", Get("foo"));
+  ASSERT_EQ(std::string(1000, 'a' + 9), Get("k1"));
+  ASSERT_EQ(std::string(1000, 'a' + 8), Get("k2"));
+  ASSERT_OK(Put("foo", "v10"));
+  Reopen(&options);
+  ASSERT_EQ("v10", Get("foo"));
+}
+
 static std::string Key(int i) {
   char buf[100];
   snprintf(buf, sizeof(buf), "key%06d", i);
@@ -819,6 +1045,735 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   return result;
 }
 
+// Write a table mapping Key(first) .. Key(last) to "value" + i
+static Status WriteExternalTable(Env* env, const std::string& fname,
+                                 int first, int last,
+                                 const std::string& value) {
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  TableBuilder builder(Options(), file);
+  for (int i = first; i <= last; i++) {
+    builder.Add(Key(i), value + NumberToString(i));
+  }
+  s = builder.Finish();
+  if (s.ok()) {
+    s = file->Close();
+  }
+  delete file;
+  return s;
+}
+
+TEST(DBTest, IngestExternalFiles) {
+  const std::string ext1 = dbname_ + "_ext1.sst";
+  const std::string ext2 = dbname_ + "_ext2.sst";
+  std::vector<std::string> files;
+  files.push_back(ext1);
+  files.push_back(ext2);
+
+  // An empty database takes the files at the bottom level
+  ASSERT_OK(WriteExternalTable(env_, ext1, 0, 99, "a"));
+  ASSERT_OK(WriteExternalTable(env_, ext2, 200, 299, "a"));
+  ASSERT_OK(db_->IngestExternalFiles(files));
+  ASSERT_TRUE(!env_->FileExists(ext1));
+  ASSERT_TRUE(!env_->FileExists(ext2));
+  ASSERT_EQ(2, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_EQ("a5", Get(Key(5)));
+  ASSERT_EQ("a250", Get(Key(250)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(150)));
+
+  // Newer values in the memtable are overridden by a later ingestion,
+  // but are still visible through an older snapshot.
+  ASSERT_OK(Put(Key(10), "memtable"));
+  ASSERT_OK(Put(Key(150), "memtable"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(WriteExternalTable(env_, ext1, 10, 20, "b"));
+  files.resize(1);
+  ASSERT_OK(db_->IngestExternalFiles(files));
+  ASSERT_EQ("b10", Get(Key(10)));
+  ASSERT_EQ("b20", Get(Key(20)));
+  ASSERT_EQ("a21", Get(Key(21)));
+  ASSERT_EQ("memtable", Get(Key(150)));
+  ASSERT_EQ("memtable", Get(Key(10), snapshot));
+  ASSERT_EQ("a20", Get(Key(20), snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("[ b10, memtable, a10 ]", AllEntriesFor(Key(10)));
+
+  // Later writes override ingested values
+  ASSERT_OK(Put(Key(11), "later"));
+  ASSERT_EQ("later", Get(Key(11)));
+
+  Reopen();
+  ASSERT_EQ("a5", Get(Key(5)));
+  ASSERT_EQ("b10", Get(Key(10)));
+  ASSERT_EQ("later", Get(Key(11)));
+  ASSERT_EQ("a250", Get(Key(250)));
+
+  // Compaction turns ingested tables into regular ones
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("a5", Get(Key(5)));
+  ASSERT_EQ("b10", Get(Key(10)));
+  ASSERT_EQ("later", Get(Key(11)));
+  ASSERT_EQ("b20", Get(Key(20)));
+  ASSERT_EQ("memtable", Get(Key(150)));
+  ASSERT_EQ("a250", Get(Key(250)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(201, count);
+  delete iter;
+}
+
+TEST(DBTest, IngestExternalFilesOverLevel0) {
+  const std::string ext = dbname_ + "_ext.sst";
+  std::vector<std::string> files(1, ext);
+
+  // With the range covered at level-1, both the flush of the memtable
+  // below and the ingested file stay at level-0.
+  MakeTables(2, Key(0), Key(100));
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_OK(Put(Key(10), "old"));
+  ASSERT_OK(WriteExternalTable(env_, ext, 10, 20, "new"));
+  ASSERT_OK(db_->IngestExternalFiles(files));
+  ASSERT_EQ("2,1,1", FilesPerLevel());
+
+  ASSERT_EQ("new10", Get(Key(10)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(Key(10));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(10), iter->key().ToString());
+  ASSERT_EQ("new10", iter->value().ToString());
+  delete iter;
+
+  std::vector<std::string> keys;
+  keys.push_back(Key(10));
+  keys.push_back(Key(20));
+  keys.push_back(Key(50));
+  std::string multi_get_result, get_result;
+  MultiGetAndGet(keys, NULL, &multi_get_result, &get_result);
+  ASSERT_EQ("new10,new20,NOT_FOUND", multi_get_result);
+  ASSERT_EQ(get_result, multi_get_result);
+}
+
+TEST(DBTest, IngestExternalFilesErrors) {
+  const std::string ext1 = dbname_ + "_ext1.sst";
+  const std::string ext2 = dbname_ + "_ext2.sst";
+  std::vector<std::string> files;
+  files.push_back(ext1);
+  files.push_back(ext2);
+
+  // Overlapping files are rejected and left where they were
+  ASSERT_OK(WriteExternalTable(env_, ext1, 0, 50, "a"));
+  ASSERT_OK(WriteExternalTable(env_, ext2, 50, 99, "a"));
+  Status s = db_->IngestExternalFiles(files);
+  ASSERT_TRUE(Slice(s.ToString()).starts_with("Invalid argument"))
+      << s.ToString();
+  ASSERT_TRUE(env_->FileExists(ext1));
+  ASSERT_TRUE(env_->FileExists(ext2));
+
+  // So are empty tables and missing files
+  ASSERT_OK(WriteExternalTable(env_, ext2, 1, 0, "a"));
+  s = db_->IngestExternalFiles(files);
+  ASSERT_TRUE(Slice(s.ToString()).starts_with("Invalid argument"))
+      << s.ToString();
+  env_->DeleteFile(ext2);
+  ASSERT_TRUE(!db_->IngestExternalFiles(files).ok());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+
+  files.resize(1);
+  ASSERT_OK(db_->IngestExternalFiles(files));
+  ASSERT_EQ("a0", Get(Key(0)));
+}
+
+TEST(DBTest, BloomFilter) {
+  Options options;
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->RandomReads();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2*N/100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->ResetRandomReads();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->RandomReads();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3*N/100);
+
+  env_->count_random_reads_.Release_Store(NULL);
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, GetAcrossManyFilesPerLevel) {
+  // Lay out level-2 files [0,9], [20,29], ... and level-1 files that
+  // straddle them, [5,14], [45,54], ..., so that each lookup in level-2
+  // is narrowed by the file it found in level-1.
+  std::map<std::string, std::string> model;
+  for (int g = 0; g < 20; g += 2) {
+    for (int i = g * 10; i < g * 10 + 10; i++) {
+      ASSERT_OK(Put(Key(i), "l2." + Key(i)));
+      model[Key(i)] = "l2." + Key(i);
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int g = 0; g < 20; g += 4) {
+    for (int i = g * 10 + 5; i < g * 10 + 15; i++) {
+      ASSERT_OK(Put(Key(i), "l1." + Key(i)));
+      model[Key(i)] = "l1." + Key(i);
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("0,5,10", FilesPerLevel());
+
+  for (int i = 0; i < 220; i++) {
+    std::map<std::string, std::string>::const_iterator it = model.find(Key(i));
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+}
+
+TEST(DBTest, MultiGet) {
+  for (int use_filter = 0; use_filter < 2; use_filter++) {
+    Options options;
+    options.env = env_;
+    options.create_if_missing = true;
+    options.block_size = 1024;
+    options.filter_policy = use_filter ? NewBloomFilterPolicy(10) : NULL;
+    DestroyAndReopen(&options);
+
+    // Spread the keys over the deeper levels, level-0 and the memtable
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_OK(Put(Key(i), Key(i) + ".v1"));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < 1000; i += 7) {
+      ASSERT_OK(Put(Key(i), Key(i) + ".v2"));
+    }
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 1000; i += 5) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    for (int i = 0; i < 1000; i += 11) {
+      ASSERT_OK(Put(Key(i), Key(i) + ".v3"));
+    }
+
+    // Unsorted, with duplicates and missing keys
+    std::vector<std::string> keys;
+    for (int i = 1100; i >= 0; i -= 3) {
+      keys.push_back(Key(i));
+      if (i % 50 == 0) {
+        keys.push_back(Key(i) + ".missing");
+        keys.push_back(Key(i));
+      }
+    }
+    std::string multi_get_result, get_result;
+    MultiGetAndGet(keys, NULL, &multi_get_result, &get_result);
+    ASSERT_EQ(get_result, multi_get_result);
+    MultiGetAndGet(keys, snapshot, &multi_get_result, &get_result);
+    ASSERT_EQ(get_result, multi_get_result);
+    db_->ReleaseSnapshot(snapshot);
+
+    // The same once everything has been compacted into one level
+    Compact("a", "z");
+    MultiGetAndGet(keys, NULL, &multi_get_result, &get_result);
+    ASSERT_EQ(get_result, multi_get_result);
+
+    delete db_;
+    db_ = NULL;
+    delete options.filter_policy;
+  }
+}
+
+TEST(DBTest, MultiGetSharesBlockReads) {
+  Options options;
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < N; i++) {
+    keys.push_back(Key(i));
+    keys.push_back(Key(i) + ".missing");
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::vector<std::string> values(keys.size());
+  std::vector<Status> statuses(keys.size());
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  db_->MultiGet(ReadOptions(), &key_slices[0], keys.size(),
+                &values[0], &statuses[0]);
+  const int reads = env_->RandomReads();
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(statuses[2*i]);
+    ASSERT_EQ(Key(i), values[2*i]);
+    ASSERT_TRUE(statuses[2*i + 1].IsNotFound());
+  }
+  // One read per data block rather than one per key
+  fprintf(stderr, "%d present and %d missing => %d reads\n", N, N, reads);
+  ASSERT_LE(reads, N / 10);
+
+  env_->count_random_reads_.Release_Store(NULL);
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+// Returns the number of keys "iter" yields after a Seek() to "target"
+static int CountFrom(Iterator* iter, const Slice& target) {
+  int count = 0;
+  for (iter->Seek(target); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  return count;
+}
+
+TEST(DBTest, PrefixSeek) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewDelimitedPrefixExtractor('/', 2);
+  DestroyAndReopen(&options);
+
+  // Tables that each span "a/x/" to "z/x/" but hold a single tenant's
+  // keys in between
+  const char* tenants[] = { "b", "d", "f" };
+  for (int t = 0; t < 3; t++) {
+    ASSERT_OK(Put(std::string("a/x/") + tenants[t], "v"));
+    ASSERT_OK(Put(std::string("z/x/") + tenants[t], "v"));
+    for (int i = 0; i < 100; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%s/e/%04d", tenants[t], i);
+      ASSERT_OK(Put(key, std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  ReadOptions bounded;
+  bounded.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(bounded);
+  ASSERT_EQ(100, CountFrom(iter, "d/e/"));
+  ASSERT_EQ(50, CountFrom(iter, "d/e/0050"));
+  ASSERT_OK(iter->status());
+
+  // A prefix that no table holds reads no data blocks
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  ASSERT_EQ(0, CountFrom(iter, "c/e/"));
+  ASSERT_EQ(0, CountFrom(iter, "e/e/0007"));
+  ASSERT_EQ(0, env_->RandomReads());
+  Iterator* unbounded = db_->NewIterator(ReadOptions());
+  unbounded->Seek("c/e/");
+  ASSERT_EQ("d/e/0000->" + std::string(100, 'v'), IterStatus(unbounded));
+  ASSERT_GT(env_->RandomReads(), 0);
+  env_->count_random_reads_.Release_Store(NULL);
+  delete unbounded;
+
+  // A key without a prefix leaves the iterator unbounded
+  ASSERT_EQ(306, CountFrom(iter, "a"));
+
+  // Only Seek() and Next() are supported
+  iter->Seek("d/e/0050");
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+  iter = db_->NewIterator(bounded);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  // Newer entries for the prefix, including deletions, are merged in
+  ASSERT_OK(Delete("d/e/0000"));
+  ASSERT_OK(Put("d/e/0100", "new"));
+  iter = db_->NewIterator(bounded);
+  iter->Seek("d/e/");
+  ASSERT_EQ("d/e/0001->" + std::string(100, 'v'), IterStatus(iter));
+  ASSERT_EQ(100, CountFrom(iter, "d/e/"));
+  delete iter;
+
+  // Tables written with another extractor are not filtered by prefix,
+  // but still by key
+  delete options.prefix_extractor;
+  options.prefix_extractor = NewFixedPrefixExtractor(2);
+  Reopen(&options);
+  iter = db_->NewIterator(bounded);
+  ASSERT_EQ(100, CountFrom(iter, "d/e/"));
+  ASSERT_EQ(0, CountFrom(iter, "c/e/"));
+  delete iter;
+  ASSERT_EQ("NOT_FOUND", Get("d/e/9998"));  // Opens the tables
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  ASSERT_EQ("NOT_FOUND", Get("d/e/9999"));
+  ASSERT_EQ(0, env_->RandomReads());
+  env_->count_random_reads_.Release_Store(NULL);
+
+  // Without an extractor the bound is ignored, and the filters still
+  // work for point lookups
+  delete options.prefix_extractor;
+  options.prefix_extractor = NULL;
+  Reopen(&options);
+  iter = db_->NewIterator(bounded);
+  ASSERT_EQ(203, CountFrom(iter, "d/e/"));
+  delete iter;
+  ASSERT_EQ("NOT_FOUND", Get("d/e/9998"));
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  ASSERT_EQ("NOT_FOUND", Get("d/e/9999"));
+  ASSERT_EQ(0, env_->RandomReads());
+  env_->count_random_reads_.Release_Store(NULL);
+
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, RowCache) {
+  Options options;
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent block cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  // Room for every row below, but not for empty rows of absent keys too
+  options.row_cache = NewLRUCache(100 << 10);
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  env_->ResetRandomReads();
+  env_->count_random_reads_.Release_Store(env_);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_GE(env_->RandomReads(), N);
+
+  // Absent keys are left to the filter and do not displace cached rows
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < 10; j++) {
+      char suffix[20];
+      snprintf(suffix, sizeof(suffix), ".missing%d", j);
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + suffix));
+    }
+  }
+
+  // Every row is cached now, so nothing is read from the table
+  env_->ResetRandomReads();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->RandomReads());
+  env_->count_random_reads_.Release_Store(NULL);
+  env_->delay_sstable_sync_.Release_Store(NULL);
+
+  // Newer versions of a key, including deletions, in the same file as
+  // an older one that a snapshot can still see
+  ASSERT_OK(Put("foo", "v1"));
+  const Snapshot* s1 = db_->GetSnapshot();
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(Put("bar", "v1"));
+  const Snapshot* s2 = db_->GetSnapshot();
+  ASSERT_OK(Delete("bar"));
+  dbfull()->TEST_CompactMemTable();
+  for (int pass = 0; pass < 2; pass++) {
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("v1", Get("foo", s1));
+    ASSERT_EQ("NOT_FOUND", Get("bar"));
+    ASSERT_EQ("v1", Get("bar", s2));
+  }
+  db_->ReleaseSnapshot(s1);
+  db_->ReleaseSnapshot(s2);
+
+  // Writes made after a key was cached shadow it
+  ASSERT_OK(Put(Key(7), "new"));
+  ASSERT_EQ("new", Get(Key(7)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("new", Get(Key(7)));
+
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+  delete options.row_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, DataBlockHashIndex) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.data_block_hash_index = true;
+  DestroyAndReopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+  }
+  const Snapshot* s1 = db_->GetSnapshot();
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_OK(Put(Key(i), "v2"));
+  }
+  for (int i = 1; i < N; i += 3) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  for (int i = 0; i < N; i++) {
+    const char* expected = (i % 3 == 0 ? "v2" :
+                            i % 3 == 1 ? "NOT_FOUND" : "v1");
+    ASSERT_EQ(expected, Get(Key(i)));
+    ASSERT_EQ("v1", Get(Key(i), s1));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  db_->ReleaseSnapshot(s1);
+
+  // Tables written with and without the index can be mixed
+  options.data_block_hash_index = false;
+  Reopen(&options);
+  ASSERT_OK(Put(Key(5), "v3"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i++) {
+    const char* expected = (i == 5 ? "v3" :
+                            i % 3 == 0 ? "v2" :
+                            i % 3 == 1 ? "NOT_FOUND" : "v1");
+    ASSERT_EQ(expected, Get(Key(i)));
+  }
+}
+
+TEST(DBTest, PartitionedIndex) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_size = 256;
+  options.index_partition_size = 64;
+  DestroyAndReopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+  }
+  const Snapshot* s1 = db_->GetSnapshot();
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_OK(Put(Key(i), "v2"));
+  }
+  for (int i = 1; i < N; i += 3) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < N; i++) {
+    const char* expected = (i % 3 == 0 ? "v2" :
+                            i % 3 == 1 ? "NOT_FOUND" : "v1");
+    ASSERT_EQ(expected, Get(Key(i)));
+    ASSERT_EQ("v1", Get(Key(i), s1));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    if (i % 7 == 0) {
+      keys.push_back(Key(i));
+      keys.push_back(Key(i) + ".missing");
+    }
+  }
+  std::string multi_get_result, get_result;
+  MultiGetAndGet(keys, NULL, &multi_get_result, &get_result);
+  ASSERT_EQ(get_result, multi_get_result);
+  MultiGetAndGet(keys, s1, &multi_get_result, &get_result);
+  ASSERT_EQ(get_result, multi_get_result);
+  db_->ReleaseSnapshot(s1);
+
+  // Tables written with and without partitions can be mixed
+  options.index_partition_size = 0;
+  Reopen(&options);
+  ASSERT_OK(Put(Key(5), "v3"));
+  dbfull()->TEST_CompactMemTable();
+  std::string expected_contents;
+  for (int i = 0; i < N; i++) {
+    const char* expected = (i == 5 ? "v3" :
+                            i % 3 == 0 ? "v2" :
+                            i % 3 == 1 ? "NOT_FOUND" : "v1");
+    ASSERT_EQ(expected, Get(Key(i)));
+    if (i % 3 != 1) {
+      expected_contents += "(" + Key(i) + "->" + expected + ")";
+    }
+  }
+  ASSERT_EQ(expected_contents, Contents());
+}
+
+// Sum of the per-shard statistics of "cache"
+static CacheShardStats TotalCacheStats(Cache* cache) {
+  std::vector<CacheShardStats> stats;
+  cache->GetShardStats(&stats);
+  CacheShardStats total = { 0, 0, 0, 0 };
+  for (size_t i = 0; i < stats.size(); i++) {
+    total.hits += stats[i].hits;
+    total.misses += stats[i].misses;
+    total.usage += stats[i].usage;
+    total.capacity += stats[i].capacity;
+  }
+  return total;
+}
+
+TEST(DBTest, BlockCacheSurvivesTableReopen) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.max_open_files = 20;  // Leaves room for 10 open tables
+  options.block_cache = NewLRUCache(1 << 20);
+  DestroyAndReopen(&options);
+
+  // Disjoint memtables become separate files that are not compacted
+  const int kFiles = 30;
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(kFiles, TotalTableFiles());
+
+  // Each pass opens every table again, but the second finds all the
+  // blocks the first cached
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kFiles; i++) {
+      ASSERT_EQ(std::string(100, 'a' + i % 26), Get(Key(i)));
+    }
+  }
+  const CacheShardStats stats = TotalCacheStats(options.block_cache);
+  ASSERT_EQ(kFiles, stats.misses);
+  ASSERT_EQ(kFiles, stats.hits);
+
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+}
+
+TEST(DBTest, DeletedTablesLeaveBlockCache) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_cache = NewLRUCache(1 << 20);
+  DestroyAndReopen(&options);
+
+  // Overlapping memtables, so that compaction merges their files
+  const int kFiles = 3;
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i)));
+    ASSERT_OK(Put(Key(kFiles), std::string(100, 'a' + i)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_EQ(std::string(100, 'a' + i), Get(Key(i)));
+  }
+  ASSERT_GT(TotalCacheStats(options.block_cache).usage, 0);
+
+  // Compaction reads without filling the cache, and erases the blocks
+  // of the tables it deletes
+  dbfull()->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ(0, TotalCacheStats(options.block_cache).usage);
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_EQ(std::string(100, 'a' + i), Get(Key(i)));
+  }
+
+  delete db_;
+  db_ = NULL;
+  delete options.block_cache;
+}
+
+TEST(DBTest, MmapReads) {
+  Options options;
+  options.env = Env::Default();  // Wrapped envs do not map files
+  options.create_if_missing = true;
+  options.use_mmap_reads = true;
+  options.compression = kNoCompression;
+  DestroyAndReopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), "v2"));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(i % 2 == 0 ? "v2" : std::string(100, 'a' + i % 26),
+                Get(Key(i)));
+    }
+    Reopen(&options);
+  }
+
+  // An iterator keeps its tables mapped after compaction deletes them
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  Compact(Key(0), Key(N));
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(N, count);
+  delete iter;
+
+  ASSERT_EQ("v2", Get(Key(0)));
+  ASSERT_EQ(std::string(100, 'b'), Get(Key(1)));
+}
+
 TEST(DBTest, ApproximateSizes) {
   Options options;
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -1337,6 +2292,111 @@ TEST(DBTest, MultiThreaded) {
   }
 }
 
+// Pipelined writes test: writers with mixed batch sizes race against a
+// reader that checks every snapshot sees a gap-free prefix of the
+// sequence numbers.
+namespace {
+
+static const int kPipelinedBatches = 1000;
+
+struct PipelinedThread {
+  DB* db;
+  int id;
+  port::AtomicPointer done;
+};
+
+static void PipelinedThreadBody(void* arg) {
+  PipelinedThread* t = reinterpret_cast<PipelinedThread*>(arg);
+  Random rnd(301 + t->id);
+  int counter = 0;
+  for (int b = 0; b < kPipelinedBatches; b++) {
+    // Mostly single puts, with large batches that fill the memtable
+    const int n = rnd.OneIn(4) ? 100 : 1;
+    WriteBatch batch;
+    for (int i = 0; i < n; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "%d.%06d", t->id, counter++);
+      batch.Put(key, std::string(100, 'a' + t->id));
+    }
+    ASSERT_OK(t->db->Write(WriteOptions(), &batch));
+  }
+  t->done.Release_Store(t);
+}
+
+// Total number of keys written by PipelinedThreadBody for "id"
+static int PipelinedKeys(int id) {
+  Random rnd(301 + id);
+  int keys = 0;
+  for (int b = 0; b < kPipelinedBatches; b++) {
+    keys += rnd.OneIn(4) ? 100 : 1;
+  }
+  return keys;
+}
+
+}  // namespace
+
+TEST(DBTest, PipelinedWrites) {
+  Options options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.write_buffer_size = 64 << 10;  // Switch memtables often
+  DestroyAndReopen(&options);
+
+  PipelinedThread thread[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    thread[id].db = db_;
+    thread[id].id = id;
+    thread[id].done.Release_Store(NULL);
+    env_->StartThread(PipelinedThreadBody, &thread[id]);
+  }
+
+  bool done = false;
+  int checks = 0;
+  while (!done) {
+    done = true;
+    for (int id = 0; id < kNumThreads; id++) {
+      if (thread[id].done.Acquire_Load() == NULL) {
+        done = false;
+      }
+    }
+
+    // Entries with sequence numbers past the snapshot's may already be
+    // in the memtable, but every one up to it must be there
+    const Snapshot* snapshot = db_->GetSnapshot();
+    const SequenceNumber last =
+        reinterpret_cast<const SnapshotImpl*>(snapshot)->number_;
+    std::vector<bool> seen(last + 1, false);
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      if (ikey.sequence <= last) {
+        ASSERT_TRUE(!seen[ikey.sequence]);
+        seen[ikey.sequence] = true;
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    db_->ReleaseSnapshot(snapshot);
+    for (SequenceNumber seq = 1; seq <= last; seq++) {
+      ASSERT_TRUE(seen[seq]) << "missing sequence " << seq << " of " << last;
+    }
+    checks++;
+  }
+  ASSERT_GT(checks, 1);
+  ASSERT_GT(TotalTableFiles(), 0);
+
+  Reopen(&options);
+  for (int id = 0; id < kNumThreads; id++) {
+    const int keys = PipelinedKeys(id);
+    for (int i = 0; i < keys; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "%d.%06d", id, i);
+      ASSERT_EQ(std::string(100, 'a' + id), Get(key));
+    }
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -1361,6 +2421,11 @@ class ModelDB: public DB {
     assert(false);      // Not implemented
     return Status::NotFound(key);
   }
+  virtual void MultiGet(const ReadOptions& options,
+                        const Slice* keys, int n,
+                        std::string* values, Status* statuses) {
+    assert(false);      // Not implemented
+  }
   virtual Iterator* NewIterator(const ReadOptions& options) {
     if (options.snapshot == NULL) {
       KVMap* saved = new KVMap;
@@ -1407,6 +2472,10 @@ class ModelDB: public DB {
   }
   virtual void CompactRange(const Slice* start, const Slice* end) {
   }
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files) {
+    assert(false);      // Not implemented
+    return Status::NotSupported("IngestExternalFiles");
+  }
 
  private:
   class ModelIter: public Iterator {
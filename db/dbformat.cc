@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <vector>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -96,6 +97,65 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const PrefixExtractor* prefix_extractor)
+    : user_policy_(p),
+      prefix_extractor_(prefix_extractor) {
+}
+
+const char* InternalFilterPolicy::Name() const {
+  // Prefixes are added to the filter, but every key still is, so filters
+  // work for point lookups whatever the extractor.  Tables record the
+  // extractor separately for prefix probes; see TableBuilder::Finish().
+  return user_policy_->Name();
+}
+
+void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
+                                        std::string* dst) const {
+  // FilterBlockBuilder passes a scratch array, so keys[] may be
+  // adjusted in place.
+  Slice* mkey = const_cast<Slice*>(keys);
+  for (int i = 0; i < n; i++) {
+    mkey[i] = ExtractUserKey(keys[i]);
+  }
+  if (prefix_extractor_ == NULL) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Keys arrive in order, so each distinct prefix is added once
+  std::vector<Slice> all(keys, keys + n);
+  Slice last_prefix;
+  bool has_last_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_last_prefix || prefix != last_prefix) {
+        all.push_back(prefix);
+        last_prefix = prefix;
+        has_last_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(&all[0], static_cast<int>(all.size()), dst);
+}
+
+bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
+  return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
+}
+
+const char* InternalPrefixExtractor::Name() const {
+  return user_extractor_->Name();
+}
+
+bool InternalPrefixExtractor::InDomain(const Slice& key) const {
+  return user_extractor_->InDomain(ExtractUserKey(key));
+}
+
+Slice InternalPrefixExtractor::Transform(const Slice& key) const {
+  return user_extractor_->Transform(ExtractUserKey(key));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/prefix_extractor.h"
 #include "leveldb/slice.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
@@ -123,6 +125,39 @@ class InternalKeyComparator : public Comparator {
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
+// Filter policy wrapper that converts from internal keys to user keys.
+// If "prefix_extractor" is non-NULL, filters also hold the prefixes of
+// the user keys, and a probe for an internal key whose user key is a
+// prefix matches if any key has that prefix.
+class InternalFilterPolicy : public FilterPolicy {
+ private:
+  const FilterPolicy* const user_policy_;
+  const PrefixExtractor* const prefix_extractor_;
+ public:
+  InternalFilterPolicy(const FilterPolicy* p,
+                       const PrefixExtractor* prefix_extractor);
+  virtual const char* Name() const;
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+
+  const FilterPolicy* user_policy() const { return user_policy_; }
+};
+
+// Prefix extractor wrapper that applies to the user key portion of
+// internal keys
+class InternalPrefixExtractor : public PrefixExtractor {
+ private:
+  const PrefixExtractor* const user_extractor_;
+ public:
+  explicit InternalPrefixExtractor(const PrefixExtractor* e)
+      : user_extractor_(e) { }
+  virtual const char* Name() const;
+  virtual bool InDomain(const Slice& key) const;
+  virtual Slice Transform(const Slice& key) const;
+
+  const PrefixExtractor* user_extractor() const { return user_extractor_; }
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
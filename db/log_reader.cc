@@ -16,13 +16,17 @@ Reader::Reporter::~Reporter() {
 }
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
       backing_store_(new char[kBlockSize]),
       buffer_(),
       eof_(false),
+      log_number_(log_number),
+      recycled_(false),
+      deferred_drop_bytes_(0),
+      deferred_drop_reason_(NULL),
       last_record_offset_(0),
       end_of_buffer_offset_(0),
       initial_offset_(initial_offset) {
@@ -138,6 +142,13 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         }
         return false;
 
+      case kOldRecord:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "partial record without end(4)");
+          scratch->clear();
+        }
+        return false;
+
       case kBadRecord:
         if (in_fragmented_record) {
           ReportCorruption(scratch->size(), "error in middle of record");
@@ -176,6 +187,32 @@ void Reader::ReportDrop(size_t bytes, const Status& reason) {
   }
 }
 
+void Reader::DeferCorruption(size_t bytes, const char* reason) {
+  if (end_of_buffer_offset_ - buffer_.size() - bytes >= initial_offset_) {
+    if (deferred_drop_bytes_ == 0) {
+      deferred_drop_reason_ = reason;
+    }
+    deferred_drop_bytes_ += bytes;
+  }
+}
+
+void Reader::ReportDeferredCorruption() {
+  if (reporter_ != NULL && deferred_drop_bytes_ > 0) {
+    reporter_->Corruption(deferred_drop_bytes_,
+                          Status::Corruption(deferred_drop_reason_));
+  }
+  deferred_drop_bytes_ = 0;
+}
+
+unsigned int Reader::StopAtOldRecord() {
+  // Whatever we dropped since the last good record was past the end
+  // of the log, so it is not corruption.
+  deferred_drop_bytes_ = 0;
+  buffer_.clear();
+  eof_ = true;
+  return kOldRecord;
+}
+
 unsigned int Reader::ReadPhysicalRecord(Slice* result) {
   while (true) {
     if (buffer_.size() < kHeaderSize) {
@@ -210,10 +247,23 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
     const unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    int header_size = kHeaderSize;
+    const bool recyclable =
+        (type >= kRecyclableFullType && type <= kRecyclableLastType);
+    if (recyclable) {
+      header_size = kRecyclableHeaderSize;
+    } else if (recycled_ && type != kZeroType) {
+      // A plain record cannot follow recyclable ones in the same log
+      return StopAtOldRecord();
+    }
+    if (header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
-      ReportCorruption(drop_size, "bad record length");
+      if (recycled_) {
+        DeferCorruption(drop_size, "bad record length");
+      } else {
+        ReportCorruption(drop_size, "bad record length");
+      }
       return kBadRecord;
     }
 
@@ -228,7 +278,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc =
+          crc32c::Value(header + 6, 1 + (header_size - kHeaderSize) + length);
       if (actual_crc != expected_crc) {
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
@@ -236,21 +287,39 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
         // like a valid log record.
         size_t drop_size = buffer_.size();
         buffer_.clear();
-        ReportCorruption(drop_size, "checksum mismatch");
+        if (recycled_) {
+          // May be a record from an earlier use of this file that our
+          // last record only partially overwrote.
+          DeferCorruption(drop_size, "checksum mismatch");
+        } else {
+          ReportCorruption(drop_size, "checksum mismatch");
+        }
         return kBadRecord;
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (recyclable) {
+      const uint32_t log_number = DecodeFixed32(header + kHeaderSize);
+      if (log_number != static_cast<uint32_t>(log_number_)) {
+        return StopAtOldRecord();
+      }
+      recycled_ = true;
+      ReportDeferredCorruption();
+    }
+
+    buffer_.remove_prefix(header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
+    if (recyclable) {
+      return type - (kRecyclableFullType - kFullType);
+    }
     return type;
   }
 }
@@ -40,8 +40,12 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // "log_number" is the number of the log being read.  Recyclable records
+  // (see log::Writer) tagged with any other number are left over from an
+  // earlier use of the file and mark the end of the log.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number);
 
   ~Reader();
 
@@ -65,6 +69,17 @@ class Reader {
   Slice buffer_;
   bool eof_;   // Last Read() indicated EOF by returning < kBlockSize
 
+  // Number of the log being read, and whether any recyclable record
+  // belonging to it has been seen.
+  uint64_t const log_number_;
+  bool recycled_;
+
+  // Corruption found in a recycled log, which is reported only once a
+  // later record of the log shows that it was not the remains of an
+  // earlier use of the file.
+  size_t deferred_drop_bytes_;
+  const char* deferred_drop_reason_;
+
   // Offset of the last record returned by ReadRecord.
   uint64_t last_record_offset_;
   // Offset of the first location past the end of buffer_.
@@ -81,7 +96,10 @@ class Reader {
     // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
     // * The record is a 0-length record (No drop is reported)
     // * The record is below constructor's initial_offset (No drop is reported)
-    kBadRecord = kMaxRecordType + 2
+    kBadRecord = kMaxRecordType + 2,
+    // Returned when we reach data left behind by an earlier use of a
+    // recycled log file.  This ends the log; no drop is reported.
+    kOldRecord = kMaxRecordType + 3
   };
 
   // Skips all blocks that are completely before "initial_offset_".
@@ -89,14 +107,26 @@ class Reader {
   // Returns true on success. Handles reporting.
   bool SkipToInitialBlock();
 
-  // Return type, or one of the preceding special values
+  // Return type, or one of the preceding special values.  Recyclable
+  // record types are mapped to the corresponding plain types.
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Discard the rest of the log and return kOldRecord.
+  unsigned int StopAtOldRecord();
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(size_t bytes, const char* reason);
   void ReportDrop(size_t bytes, const Status& reason);
 
+  // Like ReportCorruption(), but for a record of a recycled log: the
+  // drop is held back until ReportDeferredCorruption() and forgotten if
+  // the log ends first.  A record that fails its checksum or length
+  // check past the end of a recycled log is most likely the remains of
+  // the file's earlier contents, but before the end it is corruption.
+  void DeferCorruption(size_t bytes, const char* reason);
+  void ReportDeferredCorruption();
+
   // No copying allowed
   Reader(const Reader&);
   void operator=(const Reader&);
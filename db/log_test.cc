@@ -104,8 +104,9 @@ class LogTest {
   StringSource source_;
   ReportCollector report_;
   bool reading_;
-  Writer writer_;
-  Reader reader_;
+  Writer* writer_;
+  Reader* reader_;
+  std::string old_contents_;  // Contents of the file before RecycleLog()
 
   // Record metadata for testing initial offset functionality
   static size_t initial_offset_record_sizes_[];
@@ -113,14 +114,33 @@ class LogTest {
 
  public:
   LogTest() : reading_(false),
-              writer_(&dest_),
-              reader_(&source_, &report_, true/*checksum*/,
-                      0/*initial_offset*/) {
+              writer_(new Writer(&dest_)),
+              reader_(new Reader(&source_, &report_, true/*checksum*/,
+                                 0/*initial_offset*/, 0/*log_number*/)) {
+  }
+
+  ~LogTest() {
+    delete writer_;
+    delete reader_;
+  }
+
+  // Reuse the file written so far for a new recyclable log numbered
+  // "log_number".  Later writes overwrite the old contents from the
+  // start of the file and Read() expects the new log.
+  void RecycleLog(uint64_t log_number) {
+    ASSERT_TRUE(!reading_) << "RecycleLog() after starting to read";
+    old_contents_ = dest_.contents_;
+    dest_.contents_.clear();
+    delete writer_;
+    writer_ = new Writer(&dest_, log_number, true/*recyclable*/);
+    delete reader_;
+    reader_ = new Reader(&source_, &report_, true/*checksum*/,
+                         0/*initial_offset*/, log_number);
   }
 
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
-    writer_.AddRecord(Slice(msg));
+    writer_->AddRecord(Slice(msg));
   }
 
   size_t WrittenBytes() const {
@@ -130,11 +150,15 @@ class LogTest {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (old_contents_.size() > dest_.contents_.size()) {
+        dest_.contents_.append(old_contents_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
     Slice record;
-    if (reader_.ReadRecord(&record, &scratch)) {
+    if (reader_->ReadRecord(&record, &scratch)) {
       return record.ToString();
     } else {
       return "EOF";
@@ -194,7 +218,8 @@ class LogTest {
     reading_ = true;
     source_.contents_ = Slice(dest_.contents_);
     Reader* offset_reader = new Reader(&source_, &report_, true/*checksum*/,
-                                       WrittenBytes() + offset_past_end);
+                                       WrittenBytes() + offset_past_end,
+                                       0/*log_number*/);
     Slice record;
     std::string scratch;
     ASSERT_TRUE(!offset_reader->ReadRecord(&record, &scratch));
@@ -207,7 +232,7 @@ class LogTest {
     reading_ = true;
     source_.contents_ = Slice(dest_.contents_);
     Reader* offset_reader = new Reader(&source_, &report_, true/*checksum*/,
-                                       initial_offset);
+                                       initial_offset, 0/*log_number*/);
     Slice record;
     std::string scratch;
     ASSERT_TRUE(offset_reader->ReadRecord(&record, &scratch));
@@ -438,6 +463,85 @@ TEST(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2*kBlockSize);
 }
 
+TEST(LogTest, RecyclableReadWrite) {
+  RecycleLog(7);
+  Write("small");
+  ASSERT_EQ(kRecyclableHeaderSize + 5, WrittenBytes());
+  Write(BigString("medium", 50000));
+  Write("");
+  ASSERT_EQ("small", Read());
+  ASSERT_EQ(BigString("medium", 50000), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledOverRecyclableLog) {
+  RecycleLog(1);
+  for (int i = 0; i < 1000; i++) {
+    Write(BigString(NumberString(i), 100));
+  }
+  RecycleLog(2);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", kBlockSize), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledOverPlainLog) {
+  for (int i = 0; i < 1000; i++) {
+    Write(BigString(NumberString(i), 100));
+  }
+  RecycleLog(2);
+  Write("foo");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogTornWrite) {
+  RecycleLog(1);
+  Write(BigString("old", 1000));
+  RecycleLog(2);
+  Write("foo");
+  Write(BigString("bar", 500));
+  // Only part of the last record reached the file: the rest of the file
+  // still holds the old log.
+  ShrinkSize(100);
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogChecksumMismatch) {
+  RecycleLog(3);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  Write("baz");
+  IncrementByte(kRecyclableHeaderSize, 1);
+  // Records of log 3 follow the bad one, so it is corruption rather
+  // than the end of the log.
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_GE(DroppedBytes(), kBlockSize);
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+TEST(LogTest, RecycledLogBadLength) {
+  RecycleLog(3);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  Write("baz");
+  SetByte(5, '\xff');
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_GE(DroppedBytes(), kBlockSize);
+  ASSERT_EQ("OK", MatchError("bad record length"));
+}
+
 TEST(LogTest, ReadStart) {
   CheckInitialOffsetRecord(0, 0);
 }
@@ -22,6 +22,12 @@ class Writer {
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
   explicit Writer(WritableFile* dest);
+
+  // Create a writer that emits records tagged with "log_number" if
+  // "recyclable" is true, so that "*dest" may be a reused log file
+  // whose old contents have not been cleared.  Otherwise this is the
+  // same as Writer(dest).
+  Writer(WritableFile* dest, uint64_t log_number, bool recyclable);
   ~Writer();
 
   Status AddRecord(const Slice& slice);
@@ -29,6 +35,8 @@ class Writer {
  private:
   WritableFile* dest_;
   int block_offset_;       // Current offset in block
+  const uint64_t log_number_;
+  const bool recyclable_;
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -37,6 +45,8 @@ class Writer {
 
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
 
+  void Init();
+
   // No copying allowed
   Writer(const Writer&);
   void operator=(const Writer&);
@@ -57,6 +57,14 @@ class MemTable {
            const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called from several threads at once as long
+  // as no thread calls Add() at the same time.  "*rnd" must be private
+  // to the calling thread.
+  void AddConcurrently(SequenceNumber seq, ValueType type,
+                       const Slice& key,
+                       const Slice& value,
+                       Random* rnd);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
@@ -76,6 +84,11 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // Encode an entry into memory allocated from arena_ and return it.
+  const char* EncodeEntry(SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value,
+                          bool concurrent);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
@@ -7,6 +7,13 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     Tables added by DB::IngestExternalFiles() hold user keys whose
+//     sequence number is only recorded in the descriptor, so we read it
+//     from any old descriptors that survive.  An ingested table missing
+//     from them cannot be placed among the other tables; it is archived
+//     like an unreadable table, from where it can be ingested again, and
+//     the returned status says so.  Such tables are recognized by holding
+//     no key that parses as an internal key.
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
@@ -24,6 +31,7 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -48,7 +56,10 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        options_(SanitizeOptions(dbname, &icmp_, options)),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
+        iprefix_(options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, &iprefix_,
+                                 options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -69,10 +80,23 @@ class Repairer {
   Status Run() {
     Status status = FindFiles();
     if (status.ok()) {
+      ReadIngestedFiles();
       ConvertLogFilesToTables();
       ExtractMetaData();
       status = WriteDescriptor();
     }
+    if (status.ok() && !archived_ingested_.empty()) {
+      std::string numbers;
+      for (size_t i = 0; i < archived_ingested_.size(); i++) {
+        if (i > 0) {
+          numbers.push_back(',');
+        }
+        AppendNumberTo(&numbers, archived_ingested_[i]);
+      }
+      status = Status::Corruption(
+          "ingested tables with unknown sequence numbers moved to lost/",
+          numbers);
+    }
     if (status.ok()) {
       unsigned long long bytes = 0;
       for (size_t i = 0; i < tables_.size(); i++) {
@@ -99,6 +123,8 @@ class Repairer {
   std::string const dbname_;
   Env* const env_;
   InternalKeyComparator const icmp_;
+  InternalFilterPolicy const ipolicy_;
+  InternalPrefixExtractor const iprefix_;
   Options const options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -111,6 +137,11 @@ class Repairer {
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
 
+  // Sequence numbers of the ingested tables named by old descriptors
+  std::map<uint64_t, SequenceNumber> ingested_;
+  // Tables that look ingested but were not found among them
+  std::vector<uint64_t> archived_ingested_;
+
   Status FindFiles() {
     std::vector<std::string> filenames;
     Status status = env_->GetChildren(dbname_, &filenames);
@@ -144,6 +175,48 @@ class Repairer {
     return status;
   }
 
+  void ReadIngestedFiles() {
+    struct LogReporter : public log::Reader::Reporter {
+      Logger* info_log;
+      const std::string* fname;
+      virtual void Corruption(size_t bytes, const Status& s) {
+        Log(info_log, "%s: dropping %d bytes; %s",
+            fname->c_str(), static_cast<int>(bytes), s.ToString().c_str());
+      }
+    };
+
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      const std::string fname = PathJoin(dbname_, manifests_[i]);
+      SequentialFile* file;
+      Status status = env_->NewSequentialFile(fname, &file);
+      if (!status.ok()) {
+        Log(options_.info_log, "%s: ignoring %s",
+            fname.c_str(), status.ToString().c_str());
+        continue;
+      }
+      LogReporter reporter;
+      reporter.info_log = options_.info_log;
+      reporter.fname = &fname;
+      log::Reader reader(file, &reporter, true/*checksum*/,
+                         0/*initial_offset*/, 0/*log_number*/);
+      Slice record;
+      std::string scratch;
+      while (reader.ReadRecord(&record, &scratch)) {
+        VersionEdit edit;
+        if (!edit.DecodeFrom(record).ok()) {
+          continue;
+        }
+        for (size_t j = 0; j < edit.new_files().size(); j++) {
+          const FileMetaData& f = edit.new_files()[j].second;
+          if (f.global_seqno != 0) {
+            ingested_[f.number] = f.global_seqno;
+          }
+        }
+      }
+      delete file;
+    }
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
       std::string logname = LogFileName(dbname_, logs_[i]);
@@ -189,7 +262,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false/*do not checksum*/,
-                       0/*initial_offset*/);
+                       0/*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -261,18 +334,28 @@ class Repairer {
     std::string fname = TableFileName(dbname_, t->meta.number);
     int counter = 0;
     Status status = env_->GetFileSize(fname, &t->meta.file_size);
+    std::map<uint64_t, SequenceNumber>::const_iterator ingested =
+        ingested_.find(t->meta.number);
+    if (ingested != ingested_.end()) {
+      t->meta.global_seqno = ingested->second;
+    }
     if (status.ok()) {
       Iterator* iter = table_cache_->NewIterator(
-          ReadOptions(), t->meta.number, t->meta.file_size);
+          ReadOptions(), t->meta.number, t->meta.file_size,
+          t->meta.global_seqno);
       bool empty = true;
+      int unparsable = 0;
       ParsedInternalKey parsed;
       t->max_sequence = 0;
       for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
         Slice key = iter->key();
         if (!ParseInternalKey(key, &parsed)) {
-          Log(options_.info_log, "Table #%llu: unparsable key %s",
-              (unsigned long long) t->meta.number,
-              EscapeString(key).c_str());
+          if (counter > 0) {
+            Log(options_.info_log, "Table #%llu: unparsable key %s",
+                (unsigned long long) t->meta.number,
+                EscapeString(key).c_str());
+          }
+          unparsable++;
           continue;
         }
 
@@ -288,6 +371,13 @@ class Repairer {
       }
       if (!iter->status().ok()) {
         status = iter->status();
+      } else if (counter == 0 && unparsable > 0) {
+        archived_ingested_.push_back(t->meta.number);
+        status = Status::NotSupported(
+            "no internal keys; probably an ingested table");
+      } else if (unparsable > 0) {
+        Log(options_.info_log, "Table #%llu: %d unparsable keys",
+            (unsigned long long) t->meta.number, unparsable);
       }
       delete iter;
     }
@@ -322,7 +412,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest, t.meta.global_seqno);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
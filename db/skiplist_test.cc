@@ -7,6 +7,7 @@
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -371,6 +372,130 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads call InsertConcurrently() on disjoint sets of keys
+// while a reader checks that iteration always observes a sorted list.
+class ConcurrentInsertState {
+ public:
+  static const int kWriters = 4;
+  static const int kKeysPerWriter = 20000;
+
+  Arena arena_;
+  SkipList<Key, Comparator> list_;
+  port::AtomicPointer quit_flag_;
+
+  ConcurrentInsertState()
+      : list_(Comparator(), &arena_),
+        quit_flag_(NULL),
+        running_(0),
+        writers_done_(0),
+        cv_(&mu_) { }
+
+  // Keys are spread so that writers interleave throughout the list.
+  static Key MakeKey(int writer, int i) {
+    return static_cast<Key>(i) * kWriters + writer;
+  }
+
+  void Started() {
+    MutexLock l(&mu_);
+    running_++;
+    cv_.SignalAll();
+  }
+
+  void Finished(bool writer) {
+    MutexLock l(&mu_);
+    running_--;
+    if (writer) writers_done_++;
+    cv_.SignalAll();
+  }
+
+  void WaitForRunning(int n) {
+    MutexLock l(&mu_);
+    while (running_ != n) {
+      cv_.Wait();
+    }
+  }
+
+  void WaitForWriters() {
+    MutexLock l(&mu_);
+    while (writers_done_ != kWriters) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  port::Mutex mu_;
+  int running_;
+  int writers_done_;
+  port::CondVar cv_;
+};
+
+struct ConcurrentInsertArg {
+  ConcurrentInsertState* state;
+  int id;
+};
+
+static void ConcurrentInserter(void* arg) {
+  ConcurrentInsertArg* a = reinterpret_cast<ConcurrentInsertArg*>(arg);
+  ConcurrentInsertState* state = a->state;
+  Random rnd(1000 + a->id);
+  state->Started();
+  // Insert in a scrambled order so writers contend at many positions
+  const int N = ConcurrentInsertState::kKeysPerWriter;
+  for (int i = 0; i < N; i++) {
+    const int k = static_cast<int>((static_cast<uint64_t>(i) * 7919) % N);
+    state->list_.InsertConcurrently(
+        ConcurrentInsertState::MakeKey(a->id, k), &rnd);
+  }
+  state->Finished(true);
+}
+
+static void ConcurrentInsertReader(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  state->Started();
+  while (!state->quit_flag_.Acquire_Load()) {
+    SkipList<Key, Comparator>::Iterator iter(&state->list_);
+    iter.SeekToFirst();
+    if (iter.Valid()) {
+      Key prev = iter.key();
+      for (iter.Next(); iter.Valid(); iter.Next()) {
+        ASSERT_LT(prev, iter.key());
+        prev = iter.key();
+      }
+    }
+  }
+  state->Finished(false);
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  ConcurrentInsertState state;
+  ConcurrentInsertArg args[ConcurrentInsertState::kWriters];
+  Env::Default()->StartThread(ConcurrentInsertReader, &state);
+  state.WaitForRunning(1);
+  for (int i = 0; i < ConcurrentInsertState::kWriters; i++) {
+    args[i].state = &state;
+    args[i].id = i;
+    Env::Default()->StartThread(ConcurrentInserter, &args[i]);
+  }
+  state.WaitForWriters();
+  state.quit_flag_.Release_Store(&state);  // Any non-NULL arg will do
+  state.WaitForRunning(0);
+
+  // Every key must be present, exactly once, in order
+  const int total = ConcurrentInsertState::kWriters *
+      ConcurrentInsertState::kKeysPerWriter;
+  SkipList<Key, Comparator>::Iterator iter(&state.list_);
+  iter.SeekToFirst();
+  for (int i = 0; i < total; i++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(static_cast<Key>(i), iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (int i = 0; i < total; i += 97) {
+    ASSERT_TRUE(state.list_.Contains(i));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,7 @@
 
 #include "db/table_cache.h"
 
+#include <vector>
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -29,38 +30,195 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+// Presents a table of distinct user keys as a table of internal keys
+// that all carry the same sequence number and type kTypeValue.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, const Comparator* user_comparator,
+                      SequenceNumber seqno)
+      : iter_(iter),
+        user_comparator_(user_comparator),
+        tag_((seqno << 8) | kTypeValue) {
+  }
+  virtual ~GlobalSeqnoIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() {
+    iter_->SeekToFirst();
+    UpdateKey();
+  }
+  virtual void SeekToLast() {
+    iter_->SeekToLast();
+    UpdateKey();
+  }
+  virtual void Seek(const Slice& target) {
+    const Slice user_key = ExtractUserKey(target);
+    iter_->Seek(user_key);
+    // Entries for the same user key are ordered by decreasing tag, so
+    // our entry sorts before "target" if its tag is larger.
+    if (iter_->Valid() &&
+        DecodeFixed64(target.data() + target.size() - 8) < tag_ &&
+        user_comparator_->Compare(iter_->key(), user_key) == 0) {
+      iter_->Next();
+    }
+    UpdateKey();
+  }
+  virtual void Next() {
+    iter_->Next();
+    UpdateKey();
+  }
+  virtual void Prev() {
+    iter_->Prev();
+    UpdateKey();
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    return key_;
+  }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  void UpdateKey() {
+    key_.clear();
+    if (iter_->Valid()) {
+      const Slice user_key = iter_->key();
+      key_.append(user_key.data(), user_key.size());
+      PutFixed64(&key_, tag_);
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const user_comparator_;
+  const uint64_t tag_;
+  std::string key_;
+
+  // No copying allowed
+  GlobalSeqnoIterator(const GlobalSeqnoIterator&);
+  void operator=(const GlobalSeqnoIterator&);
+};
+
+// Skips the table on a Seek() to a key whose prefix the table's filters
+// rule out.  Keys with other prefixes may then be missed, so the only
+// other operation the iterator serves correctly after a Seek() is
+// Next(), as used by iterators bounded to a single prefix.
+class TableCache::PrefixFilteringIterator : public Iterator {
+ public:
+  PrefixFilteringIterator(Iterator* iter, const Table* table,
+                          const ReadOptions& options,
+                          const PrefixExtractor* prefix_extractor)
+      : iter_(iter),
+        table_(table),
+        options_(options),
+        prefix_extractor_(prefix_extractor),
+        excluded_(false) {
+  }
+  virtual ~PrefixFilteringIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return !excluded_ && iter_->Valid(); }
+  virtual void SeekToFirst() {
+    excluded_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    excluded_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Seek(const Slice& target) {
+    excluded_ = false;
+    if (prefix_extractor_->InDomain(target)) {
+      probe_.clear();
+      AppendInternalKey(&probe_,
+                        ParsedInternalKey(prefix_extractor_->Transform(target),
+                                          kMaxSequenceNumber,
+                                          kValueTypeForSeek));
+      excluded_ = !table_->PrefixMayMatch(options_, probe_);
+    }
+    if (!excluded_) {
+      iter_->Seek(target);
+    }
+  }
+  virtual void Next() {
+    assert(Valid());
+    iter_->Next();
+  }
+  virtual void Prev() {
+    assert(Valid());
+    iter_->Prev();
+  }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  Iterator* const iter_;
+  const Table* const table_;
+  const ReadOptions options_;
+  const PrefixExtractor* const prefix_extractor_;
+  bool excluded_;        // Did the last Seek() skip the table?
+  std::string probe_;    // Internal key that starts the sought prefix
+
+  // No copying allowed
+  PrefixFilteringIterator(const PrefixFilteringIterator&);
+  void operator=(const PrefixFilteringIterator&);
+};
+
 TableCache::TableCache(const std::string& dbname,
                        const Options* options,
                        int entries)
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      user_key_options_(*options),
+      cache_(NewLRUCache(entries)),
+      row_cache_id_(options->row_cache ? options->row_cache->NewId() : 0),
+      block_cache_id_(options->block_cache
+                      ? options->block_cache->NewId() : 0),
+      compressed_cache_id_(options->block_cache_compressed
+                           ? options->block_cache_compressed->NewId() : 0) {
+  // options->comparator is always the DB's InternalKeyComparator, and
+  // options->filter_policy, if set, the matching InternalFilterPolicy.
+  // Ingested tables' filters hold no prefixes.
+  user_key_options_.comparator =
+      static_cast<const InternalKeyComparator*>(options->comparator)
+          ->user_comparator();
+  if (options->filter_policy != NULL) {
+    user_key_options_.filter_policy =
+        static_cast<const InternalFilterPolicy*>(options->filter_policy)
+            ->user_policy();
+  }
+  user_key_options_.prefix_extractor = NULL;
 }
 
 TableCache::~TableCache() {
   delete cache_;
 }
 
-Iterator* TableCache::NewIterator(const ReadOptions& options,
-                                  uint64_t file_number,
-                                  uint64_t file_size,
-                                  Table** tableptr) {
-  if (tableptr != NULL) {
-    *tableptr = NULL;
-  }
-
+Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             SequenceNumber global_seqno,
+                             Cache::Handle** handle) {
+  Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
-  Cache::Handle* handle = cache_->Lookup(key);
-  if (handle == NULL) {
+  *handle = cache_->Lookup(key);
+  if (*handle == NULL) {
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    Status s = env_->NewRandomAccessFile(fname, &file);
+    if (options_->use_mmap_reads) {
+      s = env_->NewMmapRandomAccessFile(fname, &file);
+    } else {
+      s = env_->NewRandomAccessFile(fname, &file);
+    }
     if (s.ok()) {
-      s = Table::Open(*options_, file, file_size, &table);
+      s = Table::Open(global_seqno == 0 ? *options_ : user_key_options_,
+                      file, file_size, file_number, block_cache_id_,
+                      compressed_cache_id_, &table);
     }
 
     if (!s.ok()) {
@@ -68,17 +226,42 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
       delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
-      return NewErrorIterator(s);
+    } else {
+      TableAndFile* tf = new TableAndFile;
+      tf->file = file;
+      tf->table = table;
+      *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
+  }
+  return s;
+}
 
-    TableAndFile* tf = new TableAndFile;
-    tf->file = file;
-    tf->table = table;
-    handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+Iterator* TableCache::NewIterator(const ReadOptions& options,
+                                  uint64_t file_number,
+                                  uint64_t file_size,
+                                  SequenceNumber global_seqno,
+                                  Table** tableptr) {
+  if (tableptr != NULL) {
+    *tableptr = NULL;
+  }
+
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(
+        result, user_key_options_.comparator, global_seqno);
+  } else if (options.prefix_same_as_start &&
+             options_->prefix_extractor != NULL &&
+             options_->filter_policy != NULL) {
+    result = new PrefixFilteringIterator(result, table, options,
+                                         options_->prefix_extractor);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != NULL) {
     *tableptr = table;
@@ -86,10 +269,211 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+namespace {
+// Passes the entries of an ingested table on to the caller's handler
+// as internal keys carrying the table's sequence number.
+struct GlobalSeqnoSaver {
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+  uint64_t tag;
+};
+}
+
+static void SaveWithGlobalSeqno(void* arg, const Slice& k, const Slice& v) {
+  GlobalSeqnoSaver* saver = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  std::string ikey(k.data(), k.size());
+  PutFixed64(&ikey, saver->tag);
+  (*saver->handle_result)(saver->arg, ikey, v);
+}
+
+namespace {
+// Records the first entry that a lookup finds
+struct RowCapture {
+  bool found;
+  std::string key;
+  std::string value;
+};
+}
+
+static void CaptureRow(void* arg, const Slice& k, const Slice& v) {
+  RowCapture* capture = reinterpret_cast<RowCapture*>(arg);
+  capture->found = true;
+  capture->key.assign(k.data(), k.size());
+  capture->value.assign(v.data(), v.size());
+}
+
+static void DeleteRow(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// A row cache entry holds the newest entry for its user key in its file
+// as the entry's tag (sequence number and type) followed by its value.
+// Keys the file has no entry for are not cached.  Since it is the newest
+// entry, it is also what any lookup whose sequence number is at least
+// the entry's would find.
+Status TableCache::Get(const ReadOptions& options,
+                       uint64_t file_number,
+                       uint64_t file_size,
+                       SequenceNumber global_seqno,
+                       const Slice& k,
+                       void* arg,
+                       void (*saver)(void*, const Slice&, const Slice&)) {
+  Cache* row_cache = options_->row_cache;
+  if (row_cache == NULL) {
+    return GetFromTable(options, file_number, file_size, global_seqno,
+                        k, arg, saver);
+  }
+
+  const Slice user_key = ExtractUserKey(k);
+  std::string row_key;
+  PutFixed64(&row_key, row_cache_id_);
+  PutFixed64(&row_key, file_number);
+  row_key.append(user_key.data(), user_key.size());
+  Cache::Handle* handle = row_cache->Lookup(row_key);
+  if (handle == NULL) {
+    if (!options.fill_cache) {
+      return GetFromTable(options, file_number, file_size, global_seqno,
+                          k, arg, saver);
+    }
+    // Find the newest entry for user_key in the file
+    std::string newest;
+    AppendInternalKey(&newest, ParsedInternalKey(user_key, kMaxSequenceNumber,
+                                                 kValueTypeForSeek));
+    RowCapture capture;
+    capture.found = false;
+    Status s = GetFromTable(options, file_number, file_size, global_seqno,
+                            newest, &capture, &CaptureRow);
+    if (!s.ok()) {
+      return s;
+    }
+    // Only rows that were found are cached, so lookups of absent keys,
+    // which the table's filter usually answers cheaply, do not fill
+    // the cache with empty rows and push out useful ones.
+    if (!capture.found) {
+      return s;
+    }
+    ParsedInternalKey parsed;
+    if (!ParseInternalKey(capture.key, &parsed)) {
+      // Let the caller see the corruption
+      return GetFromTable(options, file_number, file_size, global_seqno,
+                          k, arg, saver);
+    }
+    if (user_key_options_.comparator->Compare(parsed.user_key,
+                                              user_key) != 0) {
+      return s;
+    }
+    std::string* row = new std::string;
+    row->append(capture.key.data() + capture.key.size() - 8, 8);
+    row->append(capture.value);
+    handle = row_cache->Insert(row_key, row, row_key.size() + row->size(),
+                               &DeleteRow);
+  }
+
+  Status s;
+  const std::string* row =
+      reinterpret_cast<std::string*>(row_cache->Value(handle));
+  const uint64_t tag = DecodeFixed64(row->data());
+  if ((tag >> 8) <= (DecodeFixed64(k.data() + k.size() - 8) >> 8)) {
+    std::string ikey(user_key.data(), user_key.size());
+    PutFixed64(&ikey, tag);
+    (*saver)(arg, ikey, Slice(row->data() + 8, row->size() - 8));
+  } else {
+    // The newest entry is not visible to this lookup
+    s = GetFromTable(options, file_number, file_size, global_seqno,
+                     k, arg, saver);
+  }
+  row_cache->Release(handle);
+  return s;
+}
+
+Status TableCache::GetFromTable(
+    const ReadOptions& options,
+    uint64_t file_number,
+    uint64_t file_size,
+    SequenceNumber global_seqno,
+    const Slice& k,
+    void* arg,
+    void (*saver)(void*, const Slice&, const Slice&)) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno == 0) {
+      s = t->InternalGet(options, k, arg, saver);
+    } else {
+      GlobalSeqnoSaver seqno_saver;
+      seqno_saver.arg = arg;
+      seqno_saver.handle_result = saver;
+      seqno_saver.tag = (global_seqno << 8) | kTypeValue;
+      // Entries newer than the lookup's sequence number are invisible;
+      // a seek would step past them to the next user key.
+      if (DecodeFixed64(k.data() + k.size() - 8) >= seqno_saver.tag) {
+        s = t->InternalGet(options, ExtractUserKey(k), &seqno_saver,
+                           &SaveWithGlobalSeqno);
+      }
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+                            uint64_t file_number,
+                            uint64_t file_size,
+                            SequenceNumber global_seqno,
+                            int n,
+                            const Slice* k,
+                            void* const* args,
+                            void (*saver)(void*, const Slice&, const Slice&)) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno == 0) {
+      s = t->InternalMultiGet(options, n, k, args, saver);
+    } else {
+      // As in Get(), but for the keys whose lookups can see the table
+      const uint64_t tag = (global_seqno << 8) | kTypeValue;
+      std::vector<GlobalSeqnoSaver> seqno_savers;
+      std::vector<Slice> user_keys;
+      seqno_savers.reserve(n);
+      user_keys.reserve(n);
+      for (int i = 0; i < n; i++) {
+        if (DecodeFixed64(k[i].data() + k[i].size() - 8) >= tag) {
+          GlobalSeqnoSaver seqno_saver;
+          seqno_saver.arg = args[i];
+          seqno_saver.handle_result = saver;
+          seqno_saver.tag = tag;
+          seqno_savers.push_back(seqno_saver);
+          user_keys.push_back(ExtractUserKey(k[i]));
+        }
+      }
+      std::vector<void*> seqno_args(seqno_savers.size());
+      for (size_t i = 0; i < seqno_savers.size(); i++) {
+        seqno_args[i] = &seqno_savers[i];
+      }
+      if (!user_keys.empty()) {
+        s = t->InternalMultiGet(options, user_keys.size(), &user_keys[0],
+                                &seqno_args[0], &SaveWithGlobalSeqno);
+      }
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
-  cache_->Erase(Slice(buf, sizeof(buf)));
+  Slice key(buf, sizeof(buf));
+  Cache::Handle* handle = cache_->Lookup(key);
+  if (handle != NULL) {
+    // The file is going away, so its blocks will not be read again
+    reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+        ->table->EraseCachedBlocks();
+    cache_->Release(handle);
+  }
+  cache_->Erase(key);
 }
 
 }  // namespace leveldb
@@ -24,25 +24,83 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  A non-zero
+  // "global_seqno" marks an ingested table of user keys; its entries are
+  // returned as internal keys carrying that sequence number.  If "tableptr" is
   // non-NULL, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or NULL if no Table object underlies
   // the returned iterator.  The returned "*tableptr" object is owned by
   // the cache and should not be deleted, and is valid for as long as the
-  // returned iterator is live.
+  // returned iterator is live.  With options.prefix_same_as_start, a
+  // Seek() of the iterator to a key whose prefix the table's filters
+  // rule out leaves it invalid without reading any data blocks.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        SequenceNumber global_seqno,
                         Table** tableptr = NULL);
 
-  // Evict any entry for the specified file number
+  // If a seek to internal key "k" in specified file finds an entry,
+  // call (*handle_result)(arg, found_key, found_value).  The file's
+  // filter, if any, is consulted first so that a key the filter rules
+  // out costs no data block read.  If options_->row_cache is set, the
+  // newest entry for the user key in the file is cached there.
+  Status Get(const ReadOptions& options,
+             uint64_t file_number,
+             uint64_t file_size,
+             SequenceNumber global_seqno,
+             const Slice& k,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Like Get() for each of the internal keys k[0,n-1], which must be
+  // sorted, passing args[i] to the handler along with the entry found
+  // for k[i].  The table is looked up once for all of them, and the
+  // row cache is not used.
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  SequenceNumber global_seqno,
+                  int n,
+                  const Slice* k,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Evict any entry for the specified file number, along with the
+  // blocks of its table if the table is open.  The blocks of a table
+  // that is not open cannot be found without reading its index, so they
+  // stay in the block cache until they age out; nothing looks them up
+  // again once the file is gone.
   void Evict(uint64_t file_number);
 
  private:
+  Status FindTable(uint64_t file_number, uint64_t file_size,
+                   SequenceNumber global_seqno, Cache::Handle**);
+
+  // Get() without the row cache
+  Status GetFromTable(const ReadOptions& options,
+                      uint64_t file_number,
+                      uint64_t file_size,
+                      SequenceNumber global_seqno,
+                      const Slice& k,
+                      void* arg,
+                      void (*handle_result)(void*, const Slice&, const Slice&));
+
   Env* const env_;
   const std::string dbname_;
   const Options* options_;
+  Options user_key_options_;  // For opening ingested tables
   Cache* cache_;
+  uint64_t row_cache_id_;     // Prefix of our keys in options_->row_cache
+
+  // Ids of our tables in options_->block_cache and
+  // options_->block_cache_compressed.  Tables are keyed there by these
+  // and their file numbers, so a table that is evicted from cache_ and
+  // opened again finds the blocks it cached before.
+  uint64_t block_cache_id_;
+  uint64_t compressed_cache_id_;
+
+  class PrefixFilteringIterator;
 };
 
 }  // namespace leveldb
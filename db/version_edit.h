@@ -22,7 +22,13 @@ struct FileMetaData {
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  // Zero for tables written by the DB.  Ingested tables (see
+  // DB::IngestExternalFiles) hold plain user keys instead, and every
+  // entry is read as a value with this sequence number.
+  SequenceNumber global_seqno;
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), global_seqno(0) { }
 };
 
 class VersionEdit {
@@ -62,12 +68,14 @@ class VersionEdit {
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               SequenceNumber global_seqno = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.global_seqno = global_seqno;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -76,6 +84,11 @@ class VersionEdit {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // The files added by this edit, with their levels
+  const std::vector< std::pair<int, FileMetaData> >& new_files() const {
+    return new_files_;
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -86,8 +86,14 @@ Version::~Version() {
 int FindFile(const InternalKeyComparator& icmp,
              const std::vector<FileMetaData*>& files,
              const Slice& key) {
-  uint32_t left = 0;
-  uint32_t right = files.size();
+  return FindFileInRange(icmp, files, key, 0, files.size());
+}
+
+int FindFileInRange(const InternalKeyComparator& icmp,
+                    const std::vector<FileMetaData*>& files,
+                    const Slice& key,
+                    uint32_t left,
+                    uint32_t right) {
   while (left < right) {
     uint32_t mid = (left + right) / 2;
     const FileMetaData* f = files[mid];
@@ -158,14 +164,21 @@ bool SomeFileOverlapsRange(
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
+//
+// If "prefix_extractor" is non-NULL, Next() after a Seek() to a key with
+// a prefix stops short of files that start past the keys with that
+// prefix, as iterators bounded to the prefix never get that far.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       const PrefixExtractor* prefix_extractor)
       : icmp_(icmp),
         flist_(flist),
+        prefix_extractor_(prefix_extractor),
+        has_prefix_(false),
         index_(flist->size()) {        // Marks as invalid
   }
   virtual bool Valid() const {
@@ -173,17 +186,35 @@ class Version::LevelFileNumIterator : public Iterator {
   }
   virtual void Seek(const Slice& target) {
     index_ = FindFile(icmp_, *flist_, target);
+    has_prefix_ = (prefix_extractor_ != NULL &&
+                   prefix_extractor_->InDomain(target));
+    if (has_prefix_) {
+      Slice prefix = prefix_extractor_->Transform(target);
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
+  virtual void SeekToFirst() {
+    index_ = 0;
+    has_prefix_ = false;
   }
-  virtual void SeekToFirst() { index_ = 0; }
   virtual void SeekToLast() {
     index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    has_prefix_ = false;
   }
   virtual void Next() {
     assert(Valid());
     index_++;
+    if (has_prefix_ && index_ < flist_->size()) {
+      const Slice smallest = (*flist_)[index_]->smallest.Encode();
+      if (!prefix_extractor_->InDomain(smallest) ||
+          prefix_extractor_->Transform(smallest) != Slice(prefix_)) {
+        index_ = flist_->size();  // Marks as invalid
+      }
+    }
   }
   virtual void Prev() {
     assert(Valid());
+    has_prefix_ = false;
     if (index_ == 0) {
       index_ = flist_->size();  // Marks as invalid
     } else {
@@ -198,36 +229,45 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_+16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const PrefixExtractor* const prefix_extractor_;
+  bool has_prefix_;             // Is Next() bounded to prefix_?
+  std::string prefix_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and
+  // global sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  const PrefixExtractor* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor : NULL;
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+      new LevelFileNumIterator(vset_->icmp_, &files_[level],
+                               prefix_extractor),
       &GetFileIterator, vset_->table_cache_, options);
 }
 
@@ -237,7 +277,8 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -250,37 +291,39 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
-// If "*iter" points at a value or deletion for user_key, store
-// either the value, or a NotFound error and return true.
-// Else return false.
-static bool GetValue(const Comparator* cmp,
-                     Iterator* iter, const Slice& user_key,
-                     std::string* value,
-                     Status* s) {
-  if (!iter->Valid()) {
-    return false;
-  }
+// Callback from TableCache::Get()
+namespace {
+enum SaverState {
+  kNotFound,
+  kFound,
+  kDeleted,
+  kCorrupt
+};
+struct Saver {
+  SaverState state;
+  const Comparator* ucmp;
+  Slice user_key;
+  std::string* value;
+};
+}
+static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+  Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
-  if (!ParseInternalKey(iter->key(), &parsed_key)) {
-    *s = Status::Corruption("corrupted key for ", user_key);
-    return true;
-  }
-  if (cmp->Compare(parsed_key.user_key, user_key) != 0) {
-    return false;
-  }
-  switch (parsed_key.type) {
-    case kTypeDeletion:
-      *s = Status::NotFound(Slice());  // Use an empty error message for speed
-      break;
-    case kTypeValue: {
-      Slice v = iter->value();
-      value->assign(v.data(), v.size());
-      break;
+  if (!ParseInternalKey(ikey, &parsed_key)) {
+    s->state = kCorrupt;
+  } else {
+    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      if (s->state == kFound) {
+        s->value->assign(v.data(), v.size());
+      }
     }
   }
-  return true;
 }
 
+// Level-0 files are numbered in the order their data was written.  This
+// holds for ingested files too: IngestExternalFiles() numbers them after
+// flushing any memtable with older data for their keys.
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -302,38 +345,49 @@ Status Version::Get(const ReadOptions& options,
   // We can search level-by-level since entries never hop across
   // levels.  Therefore we are guaranteed that if we find data
   // in an smaller level, later levels are irrelevant.
-  std::vector<FileMetaData*> tmp;
+  //
+  // The file found in one level bounds the part of the next level that
+  // can hold the key; "search_left" and "search_right" carry that range
+  // down when "narrowed" is set.
+  bool narrowed = false;
+  uint32_t search_left = 0;
+  uint32_t search_right = 0;
   FileMetaData* tmp2;
   for (int level = 0; level < config::kNumLevels; level++) {
     size_t num_files = files_[level].size();
-    if (num_files == 0) continue;
+    if (num_files == 0) {
+      narrowed = false;
+      continue;
+    }
 
     // Get the list of files to search in this level
-    FileMetaData* const* files = &files_[level][0];
+    FileMetaData* const* files;
     if (level == 0) {
-      // Level-0 files may overlap each other.  Find all files that
-      // overlap user_key and process them in order from newest to oldest.
-      tmp.reserve(num_files);
-      for (uint32_t i = 0; i < num_files; i++) {
-        FileMetaData* f = files[i];
-        if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
-            ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
-          tmp.push_back(f);
-        }
-      }
-      if (tmp.empty()) continue;
-
-      std::sort(tmp.begin(), tmp.end(), NewestFirst);
-      files = &tmp[0];
-      num_files = tmp.size();
+      // Level-0 files may overlap each other.  Visit them from newest to
+      // oldest, skipping those that do not overlap user_key below.
+      assert(level0_newest_first_.size() == num_files);
+      files = &level0_newest_first_[0];
     } else {
+      if (!narrowed) {
+        search_left = 0;
+        search_right = num_files;
+      }
       // Binary search to find earliest index whose largest key >= ikey.
-      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
+      uint32_t index = FindFileInRange(vset_->icmp_, files_[level], ikey,
+                                       search_left, search_right);
+      narrowed = (level + 1 < config::kNumLevels);
+      if (narrowed) {
+        const std::vector<uint32_t>& fences = next_level_index_[level];
+        search_left = (index == 0) ? 0 : fences[index - 1];
+        search_right = (index == num_files) ? files_[level + 1].size()
+                                            : fences[index];
+      }
+
       if (index >= num_files) {
         files = NULL;
         num_files = 0;
       } else {
-        tmp2 = files[index];
+        tmp2 = files_[level][index];
         if (ucmp->Compare(user_key, tmp2->smallest.user_key()) < 0) {
           // All of "tmp2" is past any data for user_key
           files = NULL;
@@ -346,31 +400,43 @@ Status Version::Get(const ReadOptions& options,
     }
 
     for (uint32_t i = 0; i < num_files; ++i) {
+      FileMetaData* f = files[i];
+      if (level == 0 &&
+          (ucmp->Compare(user_key, f->smallest.user_key()) < 0 ||
+           ucmp->Compare(user_key, f->largest.user_key()) > 0)) {
+        continue;
+      }
+
       if (last_file_read != NULL && stats->seek_file == NULL) {
         // We have had more than one seek for this read.  Charge the 1st file.
         stats->seek_file = last_file_read;
         stats->seek_file_level = last_file_read_level;
       }
 
-      FileMetaData* f = files[i];
       last_file_read = f;
       last_file_read_level = level;
 
-      Iterator* iter = vset_->table_cache_->NewIterator(
-          options,
-          f->number,
-          f->file_size);
-      iter->Seek(ikey);
-      const bool done = GetValue(ucmp, iter, user_key, value, &s);
-      if (!iter->status().ok()) {
-        s = iter->status();
-        delete iter;
+      Saver saver;
+      saver.state = kNotFound;
+      saver.ucmp = ucmp;
+      saver.user_key = user_key;
+      saver.value = value;
+      s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                   f->global_seqno, ikey, &saver, SaveValue);
+      if (!s.ok()) {
         return s;
-      } else {
-        delete iter;
-        if (done) {
+      }
+      switch (saver.state) {
+        case kNotFound:
+          break;      // Keep searching in other files
+        case kFound:
+          return s;
+        case kDeleted:
+          s = Status::NotFound(Slice());  // Use empty error message for speed
+          return s;
+        case kCorrupt:
+          s = Status::Corruption("corrupted key for ", user_key);
           return s;
-        }
       }
     }
   }
@@ -378,10 +444,174 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
-bool Version::UpdateStats(const GetStats& stats) {
+namespace {
+// The lookups of one Version::MultiGet() call
+struct MultiGetState {
+  const ReadOptions* options;
+  TableCache* table_cache;
+  std::vector<Slice> ikeys;           // Internal lookup keys
+  std::vector<Saver> savers;
+  Status* const* statuses;
+  std::vector<bool> done;             // Has statuses[i] been set?
+
+  // Scratch space for LookUp()
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+
+  // Look up the keys with the given indices, which must be sorted, in
+  // file "f" and set the status of those that it settles.
+  void LookUp(FileMetaData* f, const std::vector<int>& batch) {
+    batch_keys.clear();
+    batch_args.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+      batch_keys.push_back(ikeys[batch[i]]);
+      batch_args.push_back(&savers[batch[i]]);
+    }
+    Status s = table_cache->MultiGet(*options, f->number, f->file_size,
+                                     f->global_seqno, batch.size(),
+                                     &batch_keys[0], &batch_args[0],
+                                     SaveValue);
+    for (size_t i = 0; i < batch.size(); i++) {
+      const int k = batch[i];
+      if (!s.ok()) {
+        *statuses[k] = s;
+      } else {
+        switch (savers[k].state) {
+          case kNotFound:
+            continue;   // Keep searching in other files
+          case kFound:
+            *statuses[k] = Status::OK();
+            break;
+          case kDeleted:
+            *statuses[k] = Status::NotFound(Slice());
+            break;
+          case kCorrupt:
+            *statuses[k] = Status::Corruption("corrupted key for ",
+                                              savers[k].user_key);
+            break;
+        }
+      }
+      done[k] = true;
+    }
+  }
+};
+}
+
+void Version::MultiGet(const ReadOptions& options, SequenceNumber snapshot,
+                       int n, const Slice* user_keys,
+                       std::string* const* values, Status* const* statuses) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  // Build the internal lookup keys in one buffer
+  std::string buf;
+  std::vector<size_t> offsets(n + 1);
+  for (int i = 0; i < n; i++) {
+    offsets[i] = buf.size();
+    AppendInternalKey(&buf, ParsedInternalKey(user_keys[i], snapshot,
+                                              kValueTypeForSeek));
+  }
+  offsets[n] = buf.size();
+
+  MultiGetState state;
+  state.options = &options;
+  state.table_cache = vset_->table_cache_;
+  state.ikeys.resize(n);
+  state.savers.resize(n);
+  state.statuses = statuses;
+  state.done.resize(n, false);
+  for (int i = 0; i < n; i++) {
+    state.ikeys[i] = Slice(buf.data() + offsets[i],
+                           offsets[i + 1] - offsets[i]);
+    state.savers[i].state = kNotFound;
+    state.savers[i].ucmp = ucmp;
+    state.savers[i].user_key = user_keys[i];
+    state.savers[i].value = values[i];
+  }
+
+  // Indices of the keys that are still being looked for, in key order
+  std::vector<int> pending(n);
+  for (int i = 0; i < n; i++) {
+    pending[i] = i;
+  }
+
+  std::vector<int> batch;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Visit them from newest to
+      // oldest, looking up the pending keys that each one covers.
+      for (size_t i = 0; i < level0_newest_first_.size(); i++) {
+        FileMetaData* f = level0_newest_first_[i];
+        batch.clear();
+        for (size_t j = 0; j < pending.size(); j++) {
+          const int k = pending[j];
+          if (!state.done[k] &&
+              ucmp->Compare(user_keys[k], f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_keys[k], f->largest.user_key()) <= 0) {
+            batch.push_back(k);
+          }
+        }
+        if (!batch.empty()) {
+          state.LookUp(f, batch);
+        }
+      }
+    } else {
+      // Files in other levels are sorted and disjoint, so walk the
+      // pending keys and the files side by side.
+      const std::vector<FileMetaData*>& files = files_[level];
+      size_t index = FindFile(vset_->icmp_, files, state.ikeys[pending[0]]);
+      FileMetaData* batch_file = NULL;
+      batch.clear();
+      for (size_t j = 0; j < pending.size(); j++) {
+        const int k = pending[j];
+        while (index < num_files &&
+               vset_->icmp_.Compare(files[index]->largest.Encode(),
+                                    state.ikeys[k]) < 0) {
+          index++;
+        }
+        if (index == num_files) {
+          break;  // All remaining keys are past the end of this level
+        }
+        if (ucmp->Compare(user_keys[k],
+                          files[index]->smallest.user_key()) < 0) {
+          continue;  // All of files[index] is past user_keys[k]
+        }
+        if (files[index] != batch_file) {
+          if (!batch.empty()) {
+            state.LookUp(batch_file, batch);
+            batch.clear();
+          }
+          batch_file = files[index];
+        }
+        batch.push_back(k);
+      }
+      if (!batch.empty()) {
+        state.LookUp(batch_file, batch);
+      }
+    }
+
+    // Drop the keys that this level settled
+    size_t remaining = 0;
+    for (size_t j = 0; j < pending.size(); j++) {
+      if (!state.done[pending[j]]) {
+        pending[remaining++] = pending[j];
+      }
+    }
+    pending.resize(remaining);
+  }
+
+  for (size_t j = 0; j < pending.size(); j++) {
+    *statuses[pending[j]] = Status::NotFound(Slice());
+  }
+}
+
+bool Version::UpdateStats(const GetStats& stats, int seeks) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
-    f->allowed_seeks--;
+    f->allowed_seeks -= seeks;
     if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
       file_to_compact_ = f;
       file_to_compact_level_ = stats.seek_file_level;
@@ -436,6 +666,19 @@ int Version::PickLevelForMemTableOutput(
   return level;
 }
 
+int Version::PickLevelForExternalFile(
+    const Slice& smallest_user_key,
+    const Slice& largest_user_key) {
+  int level = 0;
+  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+    while (level + 1 < config::kNumLevels &&
+           !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      level++;
+    }
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(
     int level,
@@ -845,7 +1088,8 @@ Status VersionSet::Recover() {
   {
     LogReporter reporter;
     reporter.status = &s;
-    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/,
+                       0/*log_number*/);
     Slice record;
     std::string scratch;
     while (reader.ReadRecord(&record, &scratch) && s.ok()) {
@@ -962,6 +1206,26 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  // Precompute what Version::Get() needs to search the levels
+  v->level0_newest_first_ = v->files_[0];
+  std::sort(v->level0_newest_first_.begin(), v->level0_newest_first_.end(),
+            NewestFirst);
+  for (int level = 1; level + 1 < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    const std::vector<FileMetaData*>& next = v->files_[level + 1];
+    std::vector<uint32_t>* fences = &v->next_level_index_[level];
+    fences->resize(files.size());
+    // Both levels are sorted, so one merge pass finds every fence
+    uint32_t j = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+      while (j < next.size() &&
+             icmp_.Compare(next[j]->largest.Encode(),
+                           files[i]->largest.Encode()) < 0) {
+        j++;
+      }
+      (*fences)[i] = j;
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -985,7 +1249,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->global_seqno);
     }
   }
 
@@ -1036,9 +1301,12 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->global_seqno, &tableptr);
         if (tableptr != NULL) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
+          // Ingested tables are keyed by user key alone
+          result += tableptr->ApproximateOffsetOf(
+              files[i]->global_seqno == 0 ? ikey.Encode() : ikey.user_key());
         }
         delete iter;
       }
@@ -1137,12 +1405,14 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+              options, files[i]->number, files[i]->file_size,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which],
+                                              NULL),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -42,6 +42,15 @@ extern int FindFile(const InternalKeyComparator& icmp,
                     const std::vector<FileMetaData*>& files,
                     const Slice& key);
 
+// Like FindFile(), for a key known to lie in files[left,right-1] or past
+// them: returns the smallest index i in [left,right) such that
+// files[i]->largest >= key, or right if there is none.
+extern int FindFileInRange(const InternalKeyComparator& icmp,
+                           const std::vector<FileMetaData*>& files,
+                           const Slice& key,
+                           uint32_t left,
+                           uint32_t right);
+
 // Returns true iff some file in "files" overlaps the user key range
 // [*smallest,*largest].
 // smallest==NULL represents a key smaller than all keys in the DB.
@@ -72,10 +81,23 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
-  // Adds "stats" into the current state.  Returns true if a new
-  // compaction may need to be triggered, false otherwise.
+  // Look up user_keys[0,n-1], which must be sorted, as of sequence
+  // number "snapshot".  Stores what Get() would return for user_keys[i]
+  // in *statuses[i] and, if that is ok, the value in *values[i].
+  // Each level is walked once for all of the keys, and keys that fall
+  // into the same file are looked up together.  Does not collect seek
+  // statistics.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, SequenceNumber snapshot, int n,
+                const Slice* user_keys, std::string* const* values,
+                Status* const* statuses);
+
+  // Adds "stats" into the current state, counting it as "seeks" seeks
+  // (callers that only report a sample of their lookups pass the
+  // sampling period).  Returns true if a new compaction may need to be
+  // triggered, false otherwise.
   // REQUIRES: lock is held
-  bool UpdateStats(const GetStats& stats);
+  bool UpdateStats(const GetStats& stats, int seeks);
 
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
@@ -101,6 +123,13 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the deepest level at which an ingested file holding data
+  // newer than anything in this version, and covering the range
+  // [smallest_user_key,largest_user_key], can be placed: neither that
+  // level nor any level above it may overlap the range.
+  int PickLevelForExternalFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
   // Return a human readable string that describes this version's contents.
@@ -121,6 +150,18 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // The level-0 files from newest to oldest.  Set by Finalize().
+  std::vector<FileMetaData*> level0_newest_first_;
+
+  // Fence pointers that let a lookup narrow its search of a level with
+  // the file it found in the level above.  For level >= 1,
+  // next_level_index_[level][i] is the index that FindFile() returns in
+  // files_[level+1] for files_[level][i]->largest, so a key that falls
+  // after file i-1 and no later than file i of "level" can only be in
+  // files next_level_index_[level][i-1] through next_level_index_[level][i]
+  // of level+1.  Set by Finalize().
+  std::vector<uint32_t> next_level_index_[config::kNumLevels];
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -38,6 +38,12 @@ class FindFileTest {
     return FindFile(cmp, files_, target.Encode());
   }
 
+  int FindInRange(const char* key, uint32_t left, uint32_t right) {
+    InternalKey target(key, 100, kTypeValue);
+    InternalKeyComparator cmp(BytewiseComparator());
+    return FindFileInRange(cmp, files_, target.Encode(), left, right);
+  }
+
   bool Overlaps(const char* smallest, const char* largest) {
     InternalKeyComparator cmp(BytewiseComparator());
     Slice s(smallest != NULL ? smallest : "");
@@ -125,6 +131,19 @@ TEST(FindFileTest, Multiple) {
   ASSERT_TRUE(Overlaps("450", "500"));
 }
 
+TEST(FindFileTest, Range) {
+  Add("150", "200");
+  Add("200", "250");
+  Add("300", "350");
+  Add("400", "450");
+  ASSERT_EQ(0, FindInRange("100", 0, 4));
+  ASSERT_EQ(2, FindInRange("299", 1, 3));
+  ASSERT_EQ(2, FindInRange("350", 2, 3));
+  ASSERT_EQ(3, FindInRange("351", 2, 3));
+  ASSERT_EQ(4, FindInRange("451", 3, 4));
+  ASSERT_EQ(1, FindInRange("201", 1, 1));
+}
+
 TEST(FindFileTest, MultipleNullBoundaries) {
   Add("150", "200");
   Add("200", "250");
@@ -27,6 +27,11 @@ WriteBatch::WriteBatch() {
   Clear();
 }
 
+WriteBatch::WriteBatch(size_t reserved_bytes) {
+  rep_.reserve(reserved_bytes > 12 ? reserved_bytes : 12);
+  Clear();
+}
+
 WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
@@ -99,24 +104,46 @@ void WriteBatch::Put(const Slice& key, const Slice& value) {
   PutLengthPrefixedSlice(&rep_, value);
 }
 
+void WriteBatch::Put(const SliceParts& key, const SliceParts& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeValue));
+  PutLengthPrefixedSliceParts(&rep_, key);
+  PutLengthPrefixedSliceParts(&rep_, value);
+}
+
 void WriteBatch::Delete(const Slice& key) {
   WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
   rep_.push_back(static_cast<char>(kTypeDeletion));
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Delete(const SliceParts& key) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeDeletion));
+  PutLengthPrefixedSliceParts(&rep_, key);
+}
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
+  Random* rnd_;    // Non-NULL iff inserting concurrently
 
   virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
-    sequence_++;
+    Add(kTypeValue, key, value);
   }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    Add(kTypeDeletion, key, Slice());
+  }
+
+ private:
+  void Add(ValueType type, const Slice& key, const Slice& value) {
+    if (rnd_ != NULL) {
+      mem_->AddConcurrently(sequence_, type, key, value, rnd_);
+    } else {
+      mem_->Add(sequence_, type, key, value);
+    }
     sequence_++;
   }
 };
@@ -127,6 +154,21 @@ Status WriteBatchInternal::InsertInto(const WriteBatch* b,
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
+  inserter.rnd_ = NULL;
+  return b->Iterate(&inserter);
+}
+
+Status WriteBatchInternal::InsertConcurrentlyInto(const WriteBatch* b,
+                                                  MemTable* memtable) {
+  // Seeding from the sequence number gives each concurrent batch its
+  // own stream of node heights.  Keep the seed in [1, 2^31-2], the
+  // range Random cycles through.
+  Random rnd(1 + static_cast<uint32_t>(
+      WriteBatchInternal::Sequence(b) % 2147483646u));
+  MemTableInserter inserter;
+  inserter.sequence_ = WriteBatchInternal::Sequence(b);
+  inserter.mem_ = memtable;
+  inserter.rnd_ = &rnd;
   return b->Iterate(&inserter);
 }
 
@@ -135,4 +177,10 @@ void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
   b->rep_.assign(contents.data(), contents.size());
 }
 
+void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
+  SetCount(dst, Count(dst) + Count(src));
+  assert(src->rep_.size() >= 12);
+  dst->rep_.append(src->rep_.data() + 12, src->rep_.size() - 12);
+}
+
 }  // namespace leveldb
@@ -39,6 +39,15 @@ class WriteBatchInternal {
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
+
+  // Like InsertInto(), but may run concurrently with other calls to
+  // InsertConcurrentlyInto() on the same memtable.
+  static Status InsertConcurrentlyInto(const WriteBatch* batch,
+                                       MemTable* memtable);
+
+  // Append the records of "src" to "dst".  The sequence number of
+  // "dst" is left unchanged.
+  static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
 }  // namespace leveldb
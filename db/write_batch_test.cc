@@ -82,6 +82,69 @@ TEST(WriteBatchTest, Corruption) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Append) {
+  WriteBatch b1, b2;
+  WriteBatchInternal::SetSequence(&b1, 200);
+  WriteBatchInternal::SetSequence(&b2, 300);
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("",
+            PrintContents(&b1));
+  b2.Put("a", "va");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200",
+            PrintContents(&b1));
+  b2.Clear();
+  b2.Put("b", "vb");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200"
+            "Put(b, vb)@201",
+            PrintContents(&b1));
+  b2.Delete("foo");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200"
+            "Put(b, vb)@202"
+            "Put(b, vb)@201"
+            "Delete(foo)@203",
+            PrintContents(&b1));
+}
+
+TEST(WriteBatchTest, SliceParts) {
+  WriteBatch batch;
+  Slice key_parts[] = { "ba", "", "z" };
+  Slice value_parts[] = { "header:", "payload" };
+  batch.Put(SliceParts(key_parts, 3), SliceParts(value_parts, 2));
+  batch.Delete(SliceParts(key_parts, 1));
+  batch.Put(SliceParts(key_parts, 1), SliceParts());
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Put(ba, )@102"
+            "Delete(ba)@101"
+            "Put(baz, header:payload)@100",
+            PrintContents(&batch));
+
+  // Gathering produces exactly the same records as concatenating
+  WriteBatch expected;
+  expected.Put("baz", "header:payload");
+  expected.Delete("ba");
+  expected.Put("ba", "");
+  WriteBatchInternal::SetSequence(&expected, 100);
+  ASSERT_EQ(WriteBatchInternal::Contents(&expected).ToString(),
+            WriteBatchInternal::Contents(&batch).ToString());
+}
+
+TEST(WriteBatchTest, Reuse) {
+  const size_t empty_size = WriteBatch().ApproximateSize();
+  WriteBatch batch(1000);
+  const char* buffer = WriteBatchInternal::Contents(&batch).data();
+  for (int i = 0; i < 10; i++) {
+    batch.Clear();
+    ASSERT_EQ(empty_size, batch.ApproximateSize());
+    batch.Put(std::string(400, 'k'), std::string(500, 'v'));
+    ASSERT_EQ(buffer, WriteBatchInternal::Contents(&batch).data());
+  }
+  ASSERT_EQ(1, WriteBatchInternal::Count(&batch));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+// Compaction throughput assumed until the first compaction is measured.
+static const uint64_t kDefaultCompactionRate = 16 << 20;
+
+// Never pace writes slower than this, so that a few unusually slow
+// compactions cannot wedge writers completely.
+static const uint64_t kMinDelayedWriteRate = 256 << 10;
+
+// Cap on how much idle time is converted into write credit, so that a
+// quiet period cannot be followed by an unthrottled burst.
+static const uint64_t kMaxBurstMicros = 100000;
+
+WriteController::WriteController()
+    : delayed_(false),
+      rate_(kDefaultCompactionRate),
+      compaction_rate_(kDefaultCompactionRate),
+      credit_(0),
+      last_refill_micros_(0),
+      reset_bucket_(true),
+      total_delay_micros_(0) {
+}
+
+void WriteController::RecordCompaction(uint64_t bytes, uint64_t micros) {
+  if (bytes == 0 || micros == 0) {
+    return;
+  }
+  // Exponentially weighted average so that the estimate follows
+  // changes in device speed without jumping on a single outlier.
+  const uint64_t sample = bytes * 1000000 / micros;
+  compaction_rate_ = (compaction_rate_ + sample) / 2;
+}
+
+void WriteController::Update(int level0_files) {
+  if (level0_files < config::kL0_SlowdownWritesTrigger) {
+    delayed_ = false;
+    return;
+  }
+  if (!delayed_) {
+    delayed_ = true;
+    reset_bucket_ = true;
+  }
+
+  // Scale the rate down linearly as level-0 approaches the point where
+  // writes stop altogether.  At the slowdown trigger writes may proceed
+  // as fast as compactions drain them.
+  const int range =
+      config::kL0_StopWritesTrigger - config::kL0_SlowdownWritesTrigger;
+  int headroom = config::kL0_StopWritesTrigger - level0_files;
+  if (headroom < 1) headroom = 1;
+  rate_ = compaction_rate_ * headroom / range;
+  if (rate_ < kMinDelayedWriteRate) {
+    rate_ = kMinDelayedWriteRate;
+  }
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (!delayed_) {
+    return 0;
+  }
+  if (reset_bucket_) {
+    reset_bucket_ = false;
+    credit_ = 0;
+    last_refill_micros_ = now_micros;
+  }
+
+  // Refill the bucket for the time elapsed since the last refill.
+  if (now_micros > last_refill_micros_) {
+    uint64_t elapsed = now_micros - last_refill_micros_;
+    if (elapsed > kMaxBurstMicros) {
+      elapsed = kMaxBurstMicros;
+    }
+    credit_ += rate_ * elapsed / 1000000;
+    const uint64_t max_credit = rate_ * kMaxBurstMicros / 1000000;
+    if (credit_ > max_credit) {
+      credit_ = max_credit;
+    }
+    last_refill_micros_ = now_micros;
+  }
+
+  if (credit_ >= num_bytes) {
+    credit_ -= num_bytes;
+    return 0;
+  }
+
+  // Not enough credit: the writer waits until the bucket would have
+  // accrued the shortfall.  Credit accrued up to then is spent on this
+  // write, so push the refill point forward by the same amount.
+  const uint64_t shortfall = num_bytes - credit_;
+  credit_ = 0;
+  uint64_t delay = shortfall * 1000000 / rate_;
+  if (last_refill_micros_ > now_micros) {
+    // An earlier write already consumed credit up to last_refill_micros_
+    delay += last_refill_micros_ - now_micros;
+  }
+  last_refill_micros_ = now_micros + delay;
+  total_delay_micros_ += delay;
+  return delay;
+}
+
+}  // namespace leveldb
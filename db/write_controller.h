@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteController paces foreground writes once background compactions
+// start falling behind.  Rather than stalling each write for a fixed
+// amount of time, writers draw from a token bucket that refills at
+// delayed_write_rate() bytes per second.  The rate tracks the measured
+// throughput of recent compactions and shrinks as the compaction debt
+// (the number of level-0 files) grows towards the hard stop.
+//
+// A WriteController requires external synchronization.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+class WriteController {
+ public:
+  WriteController();
+
+  // Record that a background compaction wrote "bytes" bytes in
+  // "micros" microseconds.
+  void RecordCompaction(uint64_t bytes, uint64_t micros);
+
+  // Recompute the delay state given the current number of level-0 files.
+  void Update(int level0_files);
+
+  // Returns true iff writes are currently being paced.
+  bool IsDelayed() const { return delayed_; }
+
+  // Rate (in bytes per second) at which writes are let through while
+  // IsDelayed() is true.
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  // Estimated throughput (in bytes per second) of recent compactions.
+  uint64_t compaction_rate() const { return compaction_rate_; }
+
+  // Charge a write of "num_bytes" bytes issued at "now_micros" against
+  // the bucket and return the number of microseconds the writer should
+  // sleep before proceeding.  Returns 0 if writes are not delayed.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+  // Total number of microseconds of delay handed out by GetDelay().
+  uint64_t total_delay_micros() const { return total_delay_micros_; }
+
+ private:
+  bool delayed_;
+  uint64_t rate_;
+  uint64_t compaction_rate_;
+
+  // Token bucket state
+  uint64_t credit_;              // Bytes that may be written without delay
+  uint64_t last_refill_micros_;  // Credit accrued up to this time
+  bool reset_bucket_;            // Start a fresh bucket on next GetDelay()
+
+  uint64_t total_delay_micros_;
+
+  // No copying allowed
+  WriteController(const WriteController&);
+  void operator=(const WriteController&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
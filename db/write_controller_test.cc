@@ -0,0 +1,89 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "db/dbformat.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, NoDelayBelowSlowdownTrigger) {
+  WriteController wc;
+  wc.Update(config::kL0_SlowdownWritesTrigger - 1);
+  ASSERT_TRUE(!wc.IsDelayed());
+  ASSERT_EQ(0, wc.GetDelay(1000000, 1 << 20));
+  ASSERT_EQ(0, wc.total_delay_micros());
+}
+
+TEST(WriteControllerTest, RateTracksCompactions) {
+  WriteController wc;
+  // 10MB in one second, repeatedly: the estimate converges on 10MB/s
+  for (int i = 0; i < 20; i++) {
+    wc.RecordCompaction(10 << 20, 1000000);
+  }
+  ASSERT_LE(wc.compaction_rate(), 11 << 20);
+  ASSERT_GE(wc.compaction_rate(), 9 << 20);
+  wc.RecordCompaction(0, 1000);    // Ignored
+  wc.RecordCompaction(1000, 0);    // Ignored
+  ASSERT_GE(wc.compaction_rate(), 9 << 20);
+
+  wc.Update(config::kL0_SlowdownWritesTrigger);
+  ASSERT_TRUE(wc.IsDelayed());
+  ASSERT_EQ(wc.compaction_rate(), wc.delayed_write_rate());
+}
+
+TEST(WriteControllerTest, RateShrinksWithDebt) {
+  WriteController wc;
+  uint64_t last = 0;
+  for (int files = config::kL0_StopWritesTrigger - 1;
+       files >= config::kL0_SlowdownWritesTrigger;
+       files--) {
+    wc.Update(files);
+    ASSERT_TRUE(wc.IsDelayed());
+    ASSERT_GT(wc.delayed_write_rate(), last);
+    last = wc.delayed_write_rate();
+  }
+  wc.Update(0);
+  ASSERT_TRUE(!wc.IsDelayed());
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController wc;
+  wc.Update(config::kL0_SlowdownWritesTrigger);
+  const uint64_t rate = wc.delayed_write_rate();
+
+  // The bucket starts empty: a write of one second's worth of bytes
+  // must wait about a second.
+  uint64_t now = 5000000;
+  uint64_t delay = wc.GetDelay(now, rate);
+  ASSERT_GE(delay, 999000);
+  ASSERT_LE(delay, 1001000);
+
+  // A second write issued before the first one's delay has elapsed
+  // queues up behind it.
+  uint64_t delay2 = wc.GetDelay(now, rate / 2);
+  ASSERT_GE(delay2, delay + 499000);
+  ASSERT_LE(delay2, delay + 501000);
+  now += delay2;
+
+  // Writing at exactly the configured rate after that is never delayed.
+  for (int i = 0; i < 100; i++) {
+    now += 1000;
+    ASSERT_EQ(0, wc.GetDelay(now, rate / 1000));
+  }
+  ASSERT_EQ(delay + delay2, wc.total_delay_micros());
+
+  // Idle time only earns a bounded burst of credit.
+  now += 60 * 1000000ull;
+  ASSERT_GT(wc.GetDelay(now, rate), 0);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
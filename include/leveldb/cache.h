@@ -10,15 +10,17 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
+// Builtin cache implementations with a least-recently-used eviction
+// policy, a scan-resistant segmented variant of it, and its CLOCK
+// approximation are provided.  Clients may use their own
+// implementations if they want something more sophisticated (like a
 // custom eviction policy, variable cache sizing, etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <stdint.h>
+#include <vector>
 #include "leveldb/slice.h"
 
 namespace leveldb {
@@ -29,6 +31,48 @@ class Cache;
 // of Cache uses a least-recently-used eviction policy.
 extern Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but splits the cache into
+// 2^num_shard_bits shards instead of 16.  Each shard has its own lock
+// and an equal part of the capacity, so more shards let more threads
+// use the cache at once, while fewer shards keep eviction closer to
+// true LRU order in a small cache.
+// REQUIRES: 0 <= num_shard_bits <= 20
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Like NewLRUCache(capacity, num_shard_bits), but resists scans.  New
+// entries start on a probationary list and are promoted to a protected
+// list when they are looked up again.  Entries are evicted from the
+// probationary list first, so a scan that reads each block once evicts
+// only other entries that have not been used again.  The protected list
+// holds at most "protected_fraction" of the capacity; when it is full,
+// its least recently used entries move back to probation.
+//
+// Entries inserted with Cache::kHighPriority start on the protected
+// list.  A protected_fraction of 0.8 is a good starting point.
+// REQUIRES: 0 <= num_shard_bits <= 20
+// REQUIRES: 0 <= protected_fraction < 1
+extern Cache* NewSegmentedLRUCache(size_t capacity, int num_shard_bits,
+                                   double protected_fraction);
+
+// Create a new cache with a fixed size capacity that approximates
+// least-recently-used eviction with the CLOCK algorithm.  Lookup() and
+// Release() take no locks, so threads that mostly hit in the cache do
+// not contend with each other.  Entries in use are never evicted.
+//
+// The cache keeps its entries in fixed tables sized for entries whose
+// charge is about "estimated_entry_charge" (for a block cache, the
+// block size).  If entries are much smaller on average, they are
+// evicted by count before the cache reaches its capacity.
+extern Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge);
+
+// Statistics for one shard of a cache.
+struct CacheShardStats {
+  uint64_t hits;      // Lookups that found an entry
+  uint64_t misses;    // Lookups that found nothing
+  size_t usage;       // Combined charge of the entries in the shard
+  size_t capacity;    // Capacity of the shard
+};
+
 class Cache {
  public:
   Cache() { }
@@ -40,6 +84,12 @@ class Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // How valuable an inserted entry is expected to be.
+  enum Priority {
+    kNormalPriority,
+    kHighPriority
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -52,6 +102,15 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but with a hint about the entry's value.
+  // The cache returned by NewSegmentedLRUCache() gives entries with
+  // kHighPriority a place on its protected list straight away.
+  //
+  // The default implementation ignores "priority".
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -81,6 +140,13 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Append the statistics of each shard of the cache to *stats, in
+  // shard order.  Comparing shards shows whether keys spread evenly.
+  //
+  // The default implementation appends nothing, as does the cache
+  // returned by NewClockCache().
+  virtual void GetShardStats(std::vector<CacheShardStats>* stats);
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
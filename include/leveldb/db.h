@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -82,6 +84,16 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up keys[0,n-1] and store what Get() would return for keys[i]
+  // in statuses[i], and the value in values[i] if that status is ok.
+  // All keys are read from the same state of the database.  Cheaper
+  // than n calls to Get(): the keys are sorted so that each level is
+  // searched once and keys that land in the same table block share one
+  // index search and one block read.
+  virtual void MultiGet(const ReadOptions& options,
+                        const Slice* keys, int n,
+                        std::string* values, Status* statuses) = 0;
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -139,6 +151,18 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Add the tables named in "files" to the database.  Each file must
+  // have been written by a TableBuilder using this database's
+  // Options::comparator, and must contain at least one key and no key
+  // more than once.  The key ranges of the files must not overlap.
+  //
+  // The files are moved into the database (or copied, if they cannot be
+  // renamed) and become visible together, as if every key in them had
+  // just been written with Put().  Each file is placed at the deepest
+  // level it can occupy without overlapping newer data, so ingesting
+  // sorted data avoids both the log and most compaction work.
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files) = 0;
+
  private:
   // No copying allowed
   DB(const DB&);
@@ -152,7 +176,11 @@ Status DestroyDB(const std::string& name, const Options& options);
 // If a DB cannot be opened, you may attempt to call this method to
 // resurrect as much of the contents of the database as possible.
 // Some data may be lost, so be careful when calling this function
-// on a database that contains important information.
+// on a database that contains important information.  Tables added by
+// DB::IngestExternalFiles() that the old descriptors no longer describe
+// are moved to the "lost" subdirectory, from where they can be ingested
+// again; RepairDB() then returns a Corruption status naming them,
+// although the repaired database can be opened.
 Status RepairDB(const std::string& dbname, const Options& options);
 
 }  // namespace leveldb
@@ -59,6 +59,15 @@ class Env {
   virtual Status NewRandomAccessFile(const std::string& fname,
                                      RandomAccessFile** result) = 0;
 
+  // Like NewRandomAccessFile(), but the returned file may map the file
+  // into memory and serve reads by pointing into the mapping instead of
+  // copying into the caller's buffer.  The file must not be modified
+  // while it is open.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         RandomAccessFile** result);
+
   // Create an object that writes to a new file with the specified
   // name.  Deletes any existing file with the same name and creates a
   // new file.  On success, stores a pointer to the new file in
@@ -69,6 +78,19 @@ class Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) = 0;
 
+  // Create an object that writes to the file named "fname", reusing the
+  // existing file "old_fname" (which is renamed to "fname") instead of
+  // creating a new one.  The old contents are overwritten from the start
+  // but may remain visible past the end of the new data.  On success,
+  // stores a pointer to the new file in *result and returns OK.  On
+  // failure stores NULL in *result and returns non-OK.
+  //
+  // The default implementation renames the file and then calls
+  // NewWritableFile(), so nothing is actually reused.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -125,6 +147,13 @@ class Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Like Schedule(), but for short, latency-sensitive work (such as
+  // writing out a full memtable) that should not have to wait behind
+  // long-running work passed to Schedule().
+  //
+  // The default implementation calls Schedule().
+  virtual void ScheduleHighPriority(void (*function)(void* arg), void* arg);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -188,8 +217,9 @@ class RandomAccessFile {
   // to the data that was read (including if fewer than "n" bytes were
   // successfully read).  May set "*result" to point at data in
   // "scratch[0..n-1]", so "scratch[0..n-1]" must be live when
-  // "*result" is used.  If an error was encountered, returns a non-OK
-  // status.
+  // "*result" is used.  If "*result" points anywhere else, the data
+  // must remain live until this file is deleted.  If an error was
+  // encountered, returns a non-OK status.
   //
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
@@ -276,9 +306,13 @@ class EnvWrapper : public Env {
   Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
     return target_->NewRandomAccessFile(f, r);
   }
+  // NewMmapRandomAccessFile() is deliberately not forwarded: the default
+  // implementation goes through this wrapper's NewRandomAccessFile().
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     return target_->NewWritableFile(f, r);
   }
+  // ReuseWritableFile() is deliberately not forwarded: the default
+  // implementation goes through this wrapper's NewWritableFile().
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -299,6 +333,9 @@ class EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void ScheduleHighPriority(void (*f)(void*), void* a) {
+    return target_->ScheduleHighPriority(f, a);
+  }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
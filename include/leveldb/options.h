@@ -12,7 +12,9 @@ namespace leveldb {
 class Cache;
 class Comparator;
 class Env;
+class FilterPolicy;
 class Logger;
+class PrefixExtractor;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -81,6 +83,34 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // If true, writers whose batches are committed together in one log
+  // record insert their own batches into the memtable in parallel
+  // instead of leaving all of the inserts to a single thread.  This
+  // helps write throughput when many threads write concurrently.
+  //
+  // Default: true
+  bool allow_concurrent_memtable_write;
+
+  // Maximum number of memtables, including the one currently being
+  // written, to hold in memory.  When the current memtable fills up
+  // while older ones are still being compacted, it is set aside and
+  // writes continue into a fresh memtable; writes only stall once this
+  // many memtables are in memory.  All of the memtables waiting for
+  // compaction are flushed together into a single level-0 table.
+  //
+  // Default: 2
+  int max_write_buffer_number;
+
+  // If non-zero, up to this many obsolete log files are kept around and
+  // reused for new logs instead of being deleted.  Writing over a file
+  // whose blocks are already allocated avoids the file system metadata
+  // updates (and the extra syncs they cost) of growing a fresh file.
+  // Logs are then written in a format that lets recovery tell new
+  // records from ones left over from the file's earlier use.
+  //
+  // Default: 0
+  int recycle_log_file_num;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -88,6 +118,15 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // If true, table files are opened with Env::NewMmapRandomAccessFile()
+  // and, where the Env maps them into memory, uncompressed blocks are
+  // used in place instead of being copied into the block cache.  This
+  // suits read-heavy databases that fit in the operating system's page
+  // cache; it is most useful with compression disabled.
+  //
+  // Default: false
+  bool use_mmap_reads;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -96,6 +135,24 @@ struct Options {
   // Default: NULL
   Cache* block_cache;
 
+  // If non-NULL, use the specified cache as a second tier below
+  // block_cache that holds blocks in their compressed form.  A block
+  // that misses in block_cache but is found here is decompressed
+  // without reading the file.  Since compressed blocks are smaller,
+  // this cache holds several blocks in the memory that block_cache
+  // needs for one.  Its capacity is set when it is created, apart from
+  // the capacity of block_cache.  Blocks stored without compression are
+  // never put in it.
+  // Default: NULL
+  Cache* block_cache_compressed;
+
+  // If non-NULL, use the specified cache for the key/value pairs that
+  // Get() finds in table files.  A hit skips the table's index and data
+  // blocks entirely, which helps when a small set of keys receives most
+  // of the reads.  Entries are charged by their size in bytes.
+  // Default: NULL
+  Cache* row_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -111,6 +168,26 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // If true, each data block carries a small hash index (about one byte
+  // per key) that lets DB::Get() go straight to the restart point of
+  // the key it wants instead of binary searching the block.  Tables
+  // written with this option cannot be read by leveldb versions that
+  // predate it.  This parameter can be changed dynamically.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
+  // If non-zero, the index of each table is split into partitions of
+  // about this many bytes.  Only a small top-level index that points at
+  // the partitions stays in memory while a table is open; partitions
+  // are read on demand through the block cache like data blocks, so
+  // index memory is bounded by the cache.  Tables written with this
+  // option cannot be read by leveldb versions that predate it.  This
+  // parameter can be changed dynamically.
+  //
+  // Default: 0 (each table keeps its whole index in memory)
+  size_t index_partition_size;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -127,6 +204,26 @@ struct Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression;
 
+  // If non-NULL, use the specified filter policy to reduce disk reads.
+  // Each table then carries a filter of the keys in each of its data
+  // blocks, and a DB::Get() for a key the filter rules out skips the
+  // block read.  Many applications will benefit from passing the result
+  // of NewBloomFilterPolicy() here.
+  //
+  // Default: NULL
+  const FilterPolicy* filter_policy;
+
+  // If non-NULL, and filter_policy is also set, filters record the
+  // prefix of each key as well as the key itself.  Iterators created
+  // with ReadOptions::prefix_same_as_start then skip tables that hold
+  // no keys under the prefix they seek to.  Filters written with a
+  // different extractor, or none, are not used for that, so changing it
+  // costs prefix filtering on existing tables until they are compacted.
+  // Point lookups use the filters whatever the extractor.
+  //
+  // Default: NULL
+  const PrefixExtractor* prefix_extractor;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -150,10 +247,21 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If true, and the DB has a prefix_extractor, an iterator only
+  // returns keys that share the prefix of the target of its last
+  // Seek(), becoming invalid at the first key that does not, and it
+  // skips tables whose filters rule that prefix out.  Such an iterator
+  // supports only Seek() and Next(); SeekToFirst(), SeekToLast() and
+  // Prev() make it invalid with a NotSupported status.  A Seek() to a
+  // key without a prefix iterates over all later keys.
+  // Default: false
+  bool prefix_same_as_start;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        prefix_same_as_start(false) {
   }
 };
 
@@ -177,8 +285,20 @@ struct WriteOptions {
   // Default: false
   bool sync;
 
+  // If true, the write is applied to the memtable without being
+  // appended to the write-ahead log.  Such a write becomes durable
+  // only once its memtable has been compacted to a table file; if the
+  // process crashes before then, the write is lost.  Useful for bulk
+  // loads that can be redone from scratch after a crash.
+  //
+  // A write may not set both sync and disable_wal.
+  //
+  // Default: false
+  bool disable_wal;
+
   WriteOptions()
-      : sync(false) {
+      : sync(false),
+        disable_wal(false) {
   }
 };
 
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a PrefixExtractor that maps keys
+// to prefixes, such as the "tenant/entity/" part of a key of the form
+// "tenant/entity/...".  Filters then also record the prefixes of the
+// keys in each table, and iterators that are bounded to a single prefix
+// (see ReadOptions::prefix_same_as_start) use them to skip tables that
+// hold no keys under the prefix.
+//
+// Keys that share a prefix must be adjacent in the database's key
+// order.  A prefix that is a leading run of the key's bytes satisfies
+// this for the default bytewise comparator.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PREFIX_EXTRACTOR_H_
+#define STORAGE_LEVELDB_INCLUDE_PREFIX_EXTRACTOR_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class PrefixExtractor {
+ public:
+  virtual ~PrefixExtractor();
+
+  // Return the name of this extractor.  Filters record the name, so
+  // if the mapping from keys to prefixes changes, the name returned by
+  // this method must change too.
+  virtual const char* Name() const = 0;
+
+  // Return true iff "key" has a prefix.  Keys without one are never
+  // filtered by prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Return the prefix of "key", which must refer to a leading part of
+  // key's bytes.  The prefix of a prefix must be itself.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a new extractor whose prefix is the first "length" bytes of
+// each key.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const PrefixExtractor* NewFixedPrefixExtractor(size_t length);
+
+// Return a new extractor whose prefix is each key up to and including
+// the "count"th occurrence of "delimiter".  Keys with fewer occurrences
+// have no prefix.  For example, NewDelimitedPrefixExtractor('/', 2)
+// maps "tenant/entity/id" to "tenant/entity/".
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const PrefixExtractor* NewDelimitedPrefixExtractor(char delimiter,
+                                                          int count);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PREFIX_EXTRACTOR_H_
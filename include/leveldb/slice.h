@@ -84,6 +84,17 @@ class Slice {
   // Intentionally copyable
 };
 
+// A sequence of slices that together make up one string, so that keys
+// and values built from several pieces can be passed without first
+// being concatenated.
+struct SliceParts {
+  SliceParts() : parts(NULL), num_parts(0) { }
+  SliceParts(const Slice* p, int n) : parts(p), num_parts(n) { }
+
+  const Slice* parts;
+  int num_parts;
+};
+
 inline bool operator==(const Slice& x, const Slice& y) {
   return ((x.size() == y.size()) &&
           (memcmp(x.data(), y.data(), x.size()) == 0));
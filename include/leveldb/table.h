@@ -6,12 +6,14 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <string>
 #include "leveldb/iterator.h"
 
 namespace leveldb {
 
 class Block;
 class BlockHandle;
+class Footer;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
@@ -38,6 +40,22 @@ class Table {
                      uint64_t file_size,
                      Table** table);
 
+  // Like Open() above, for the table in file number "file_number" of a
+  // database.  Its blocks are cached in options.block_cache under
+  // "cache_id" and the file number, and in options.block_cache_compressed
+  // under "compressed_cache_id" and the file number, where the ids come
+  // from NewId() of the respective caches.  A table opened again with
+  // the same ids and file number finds the blocks that were cached
+  // while it was open before, so callers that keep their ids for the
+  // life of a database may close and reopen its tables freely.
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     uint64_t file_number,
+                     uint64_t cache_id,
+                     uint64_t compressed_cache_id,
+                     Table** table);
+
   ~Table();
 
   // Returns a new iterator over the table contents.
@@ -53,12 +71,67 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Erase the table's blocks from options.block_cache and
+  // options.block_cache_compressed.  Used when the table's file is
+  // deleted, so that its blocks do not linger until they are evicted.
+  // Blocks cached through an earlier Table for the same file are erased
+  // too; blocks of a file with no open Table are left to age out.
+  void EraseCachedBlocks() const;
+
  private:
   struct Rep;
   Rep* rep_;
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static Iterator* BlockReader(void*, const ReadOptions&, const Slice&,
+                               bool high_priority);
+
+  // Returns an iterator over the entries of the table's index, reading
+  // index partitions as needed if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Erases the block whose encoded handle is "index_value" from the
+  // block caches.
+  void EraseBlock(const Slice& index_value) const;
+
+  // Finds the index entry of the data block that may hold "k" and
+  // stores its location in *handle and its key in *index_key (if
+  // non-NULL).  Sets *found to false if "k" is past the last block or
+  // on error.  Reads at most one index partition.
+  Status FindDataBlock(const ReadOptions&, const Slice& k, bool* found,
+                       BlockHandle* handle, std::string* index_key) const;
+
+  // Calls (*handle_result)(arg, ...) with the entry found after a call
+  // to Seek(key).  May not make such a call if filter policy says
+  // that key is not present.  Reads at most one data block (and one
+  // index partition) and does not allocate any iterators.
+  friend class TableCache;
+  Status InternalGet(
+      const ReadOptions&, const Slice& key,
+      void* arg,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // Like InternalGet() for each of keys[0,n-1], which must be sorted,
+  // passing args[i] along with the entry found for keys[i].  Keys that
+  // fall into the same block share one index search and one block
+  // read, and the filter is checked for all of them before the block
+  // is read.
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys, void* const* args,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // Returns false if the table's filters show that it holds no key with
+  // the prefix of "probe" under options.prefix_extractor.  "probe" must
+  // sort before all keys with its prefix, and the filter policy must
+  // treat it as matching any such key.  Reads no data blocks, but may
+  // read index partitions.
+  bool PrefixMayMatch(const ReadOptions&, const Slice& probe) const;
+
+  void ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value);
 
   // No copying allowed
   Table(const Table&);
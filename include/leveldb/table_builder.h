@@ -76,7 +76,11 @@ class TableBuilder {
 
  private:
   bool ok() const { return status().ok(); }
+  void AddIndexEntry();
+  void FinishIndexPartition();
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteBlock(const Slice& raw, BlockHandle* handle);
+  void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
   Rep* rep_;
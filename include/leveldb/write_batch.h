@@ -27,21 +27,40 @@
 namespace leveldb {
 
 class Slice;
+struct SliceParts;
 
 class WriteBatch {
  public:
   WriteBatch();
+
+  // Create a batch whose buffer can hold "reserved_bytes" bytes of
+  // updates before it needs to grow.
+  explicit WriteBatch(size_t reserved_bytes);
+
   ~WriteBatch();
 
   // Store the mapping "key->value" in the database.
   void Put(const Slice& key, const Slice& value);
 
+  // Variant of Put() that gathers the key and value from the given
+  // parts, which are copied straight into the batch.
+  void Put(const SliceParts& key, const SliceParts& value);
+
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
-  // Clear all updates buffered in this batch.
+  // Variant of Delete() that gathers the key from the given parts.
+  void Delete(const SliceParts& key);
+
+  // Clear all updates buffered in this batch.  The buffer is kept, so a
+  // batch that is cleared and refilled for every write stops allocating
+  // once it has grown to the size of the largest batch.
   void Clear();
 
+  // The number of bytes of buffered updates, including a small fixed
+  // header.
+  size_t ApproximateSize() const { return rep_.size(); }
+
   // Support for iterating over the contents of a batch.
   class Handler {
    public:
@@ -29,6 +29,9 @@
 #ifdef OS_MACOSX
 #include <libkern/OSAtomic.h>
 #endif
+#ifdef __SUNPRO_CC
+#include <atomic.h>
+#endif
 
 #if defined(_M_X64) || defined(__x86_64__)
 #define ARCH_CPU_X86_FAMILY 1
@@ -104,6 +107,20 @@ class AtomicPointer {
     MemoryBarrier();
     rep_ = v;
   }
+  // Atomically replaces the stored pointer with "v" if it currently
+  // equals "expected".  Returns true iff the swap happened.  Acts as a
+  // full memory barrier.
+  inline bool CompareAndSwap(void* expected, void* v) {
+#if defined(OS_WIN) && defined(COMPILER_MSVC)
+    return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+#elif defined(OS_MACOSX)
+    return OSAtomicCompareAndSwapPtrBarrier(expected, v, &rep_);
+#elif defined(__SUNPRO_CC)
+    return atomic_cas_ptr(&rep_, expected, v) == expected;
+#else
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+#endif
+  }
 };
 
 // AtomicPointer based on <cstdatomic>
@@ -126,6 +143,9 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return rep_.compare_exchange_strong(expected, v);
+  }
 };
 
 // We have neither MemoryBarrier(), nor <cstdatomic>
@@ -115,6 +115,9 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_ = v;
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+  }
 };
 
 // TODO(gabor): Implement compress
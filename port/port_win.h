@@ -200,6 +200,10 @@ class AtomicPointer {
   void NoBarrier_Store(void* v) {
     rep_ = v;
   }
+
+  bool CompareAndSwap(void* expected, void* v) {
+    return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+  }
 };
 
 inline bool Snappy_Compress(const char* input, size_t length,
@@ -9,6 +9,7 @@
 #include <vector>
 #include <algorithm>
 #include "leveldb/comparator.h"
+#include "table/format.h"
 #include "util/coding.h"
 #include "util/logging.h"
 
@@ -16,26 +17,44 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= 2*sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+          ~kBlockHashIndexFlag);
 }
 
-Block::Block(const char* data, size_t size)
-    : data_(data),
-      size_(size) {
+Block::Block(const BlockContents& contents)
+    : data_(contents.data.data()),
+      size_(contents.data.size()),
+      num_buckets_(0),
+      owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
-    if (restart_offset_ > size_ - sizeof(uint32_t)) {
-      // The size is too small for NumRestarts() and therefore
-      // restart_offset_ wrapped around.
+    return;
+  }
+  uint64_t trailer_size = sizeof(uint32_t);
+  if (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockHashIndexFlag) {
+    if (size_ < 2*sizeof(uint32_t)) {
       size_ = 0;
+      return;
     }
+    num_buckets_ = DecodeFixed32(data_ + size_ - 2*sizeof(uint32_t));
+    trailer_size += static_cast<uint64_t>(num_buckets_) + sizeof(uint32_t);
+  }
+  if (size_ >= 2*sizeof(uint32_t)) {
+    trailer_size += static_cast<uint64_t>(NumRestarts()) * sizeof(uint32_t);
+  }
+  if (trailer_size > size_) {
+    // The size is too small for the restart array and hash index
+    size_ = 0;
+    num_buckets_ = 0;
+  } else {
+    restart_offset_ = size_ - trailer_size;
   }
 }
 
 Block::~Block() {
-  delete[] data_;
+  if (owned_) {
+    delete[] data_;
+  }
 }
 
 // Helper routine: decode the next block entry starting at "p",
@@ -157,6 +176,21 @@ class Block::Iter : public Iterator {
     } while (ParseNextKey() && NextEntryOffset() < original);
   }
 
+  // Position at the first entry with a key >= target, starting the
+  // search at the specified restart point.
+  // REQUIRES: no entry before restart point "index" is >= target
+  void SeekFromRestartPoint(uint32_t index, const Slice& target) {
+    SeekToRestartPoint(index);
+    while (true) {
+      if (!ParseNextKey()) {
+        return;
+      }
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+    }
+  }
+
   virtual void Seek(const Slice& target) {
     // Binary search in restart array to find the first restart point
     // with a key >= target
@@ -186,15 +220,7 @@ class Block::Iter : public Iterator {
     }
 
     // Linear search (within restart block) for first key >= target
-    SeekToRestartPoint(left);
-    while (true) {
-      if (!ParseNextKey()) {
-        return;
-      }
-      if (Compare(key_, target) >= 0) {
-        return;
-      }
-    }
+    SeekFromRestartPoint(left, target);
   }
 
   virtual void SeekToFirst() {
@@ -260,4 +286,37 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   }
 }
 
+Status Block::Get(const Comparator* cmp, const Slice& target,
+                  void* arg,
+                  void (*handle_result)(void*, const Slice&, const Slice&)) {
+  if (size_ < 2*sizeof(uint32_t)) {
+    return Status::Corruption("bad block contents");
+  }
+  const uint32_t num_restarts = NumRestarts();
+  if (num_restarts == 0) {
+    return Status::OK();
+  }
+  Iter iter(cmp, data_, restart_offset_, num_restarts);
+  uint8_t bucket = kHashIndexCollision;
+  if (num_buckets_ > 0 && target.size() >= 8) {
+    const char* buckets = data_ + size_ - 2*sizeof(uint32_t) - num_buckets_;
+    bucket = static_cast<uint8_t>(
+        buckets[BlockHashIndexHash(target) % num_buckets_]);
+  }
+  if (bucket == kHashIndexNoEntry) {
+    return Status::OK();  // No entry for target's user key
+  } else if (bucket == kHashIndexCollision) {
+    iter.Seek(target);
+  } else if (bucket < num_restarts) {
+    // Every entry before the first one for target's user key is < target
+    iter.SeekFromRestartPoint(bucket, target);
+  } else {
+    return Status::Corruption("bad block hash index");
+  }
+  if (iter.Valid()) {
+    (*handle_result)(arg, iter.key(), iter.value());
+  }
+  return iter.status();
+}
+
 }  // namespace leveldb
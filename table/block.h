@@ -11,25 +11,38 @@
 
 namespace leveldb {
 
+struct BlockContents;
 class Comparator;
 
 class Block {
  public:
-  // Initialize the block with the specified contents.
-  // Takes ownership of data[] and will delete[] it when done.
-  Block(const char* data, size_t size);
+  // Initialize the block with the specified contents.  Takes ownership
+  // of contents.data if it is heap allocated.
+  explicit Block(const BlockContents& contents);
 
   ~Block();
 
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Calls (*handle_result)(arg, ...) with the first entry whose key is
+  // >= target, if there is one.  Equivalent to seeking an iterator from
+  // NewIterator(), but the search runs on the stack without allocating
+  // an iterator.  If the block has a hash index, target is an internal
+  // key, and the block holds no entry for target's user key, may instead
+  // make no call or pass a later entry.
+  Status Get(const Comparator* comparator, const Slice& target,
+             void* arg,
+             void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
  private:
   uint32_t NumRestarts() const;
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  uint32_t num_buckets_;        // Size of the hash index, or 0 if none
+  bool owned_;                  // Block owns data_[]
 
   // No copying allowed
   Block(const Block&);
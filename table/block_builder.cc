@@ -25,6 +25,20 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options.data_block_hash_index is set, keys are internal keys, and
+// there are at most kMaxHashIndexRestarts restart points, the trailer
+// instead has the form:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[BlockHashIndexHash(key) % num_buckets] holds the index of the
+// restart point under which the first (newest) entry for the key's user
+// key falls, kHashIndexNoEntry if no user key in the block hashes to the
+// bucket, or kHashIndexCollision if user keys under different restart
+// points do.  A point lookup can then skip the binary search over the
+// restart array.  Readers that predate the flag cannot read such blocks.
 
 #include "table/block_builder.h"
 
@@ -32,6 +46,7 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -40,7 +55,8 @@ BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      hashable_(true) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,12 +68,32 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  key_hashes_.clear();
+  key_restarts_.clear();
+  hashable_ = true;
+}
+
+// Number of hash index buckets for n user keys, keeping the index at
+// most 3/4 full
+static size_t NumHashIndexBuckets(size_t n) {
+  return n * 4 / 3 + 1;
+}
+
+bool BlockBuilder::UseHashIndex() const {
+  return (options_->data_block_hash_index &&
+          hashable_ &&
+          restarts_.size() <= kMaxHashIndexRestarts);
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                        // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +   // Restart array
-          sizeof(uint32_t));                      // Restart array length
+  size_t estimate = (buffer_.size() +                      // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) + // Restart array
+                     sizeof(uint32_t));                    // Restart count
+  if (UseHashIndex()) {
+    estimate += (NumHashIndexBuckets(key_hashes_.size()) +  // Buckets
+                 sizeof(uint32_t));                         // Bucket count
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -65,7 +101,24 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (UseHashIndex()) {
+    const size_t num_buckets = NumHashIndexBuckets(key_hashes_.size());
+    std::string buckets(num_buckets, static_cast<char>(kHashIndexNoEntry));
+    for (size_t i = 0; i < key_hashes_.size(); i++) {
+      char* bucket = &buckets[key_hashes_[i] % num_buckets];
+      const uint8_t restart = static_cast<uint8_t>(key_restarts_[i]);
+      if (static_cast<uint8_t>(*bucket) == kHashIndexNoEntry) {
+        *bucket = static_cast<char>(restart);
+      } else if (static_cast<uint8_t>(*bucket) != restart) {
+        *bucket = static_cast<char>(kHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return Slice(buffer_);
 }
@@ -90,6 +143,18 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (options_->data_block_hash_index && hashable_) {
+    if (key.size() < 8) {
+      hashable_ = false;   // Not an internal key
+    } else if (buffer_.empty() ||
+               Slice(key.data(), key.size() - 8) !=
+               Slice(last_key_.data(), last_key_.size() - 8)) {
+      // First entry for this user key
+      key_hashes_.push_back(BlockHashIndexHash(key));
+      key_restarts_.push_back(restarts_.size() - 1);
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
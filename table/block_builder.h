@@ -47,6 +47,14 @@ class BlockBuilder {
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
 
+  // Hash index input: for the first entry of each user key, the hash of
+  // the user key and the restart point the entry falls under
+  std::vector<uint32_t> key_hashes_;
+  std::vector<uint32_t> key_restarts_;
+  bool                  hashable_;    // Are all keys long enough to hash?
+
+  bool UseHashIndex() const;
+
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
   void operator=(const BlockBuilder&);
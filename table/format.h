@@ -46,7 +46,7 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer() : partitioned_index_(false) { }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -60,6 +60,13 @@ class Footer {
     index_handle_ = h;
   }
 
+  // True if the index block is the top level of a partitioned index:
+  // its entries point at index partitions instead of data blocks.  The
+  // footer records this with a different magic number so that readers
+  // that do not know about partitioned indexes reject the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool b) { partitioned_index_ = b; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
@@ -73,6 +80,7 @@ class Footer {
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_;
 };
 
 // kTableMagicNumber was picked by running
@@ -80,9 +88,35 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// kPartitionedIndexTableMagicNumber marks tables with a partitioned
+// index.  It was picked by running
+//    echo leveldb partitioned index | sha1sum
+// and taking the leading 64 bits.
+static const uint64_t kPartitionedIndexTableMagicNumber =
+    0x02a0a4d7ece254daull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// A block whose restart point count has kBlockHashIndexFlag set carries
+// a hash index of its user keys after its restart array.  See
+// block_builder.cc for the layout.  Bucket values are restart point
+// indices, or one of the markers below.
+static const uint32_t kBlockHashIndexFlag = 0x80000000u;
+static const uint8_t kHashIndexNoEntry = 255;
+static const uint8_t kHashIndexCollision = 254;
+static const uint32_t kMaxHashIndexRestarts = kHashIndexCollision;
+
+// Return the hash index hash of the user key within internal key "key".
+// REQUIRES: key.size() >= 8
+extern uint32_t BlockHashIndexHash(const Slice& key);
+
+struct BlockContents {
+  Slice data;           // Actual contents of data
+  bool cachable;        // True iff data can be cached
+  bool heap_allocated;  // True iff caller should delete[] data.data()
+};
+
 // Read the block identified by "handle" from "file".  On success,
 // store a pointer to the heap-allocated result in *block and return
 // OK.  On failure store NULL in *block and return non-OK.
@@ -91,6 +125,29 @@ extern Status ReadBlock(RandomAccessFile* file,
                         const BlockHandle& handle,
                         Block** block);
 
+// Like ReadBlock(), but returns the uncompressed block contents
+// themselves.  If the file hands out its own memory (as a memory-mapped
+// file does), an uncompressed block refers to it directly instead of
+// being copied, and is not worth caching.
+extern Status ReadBlockContents(RandomAccessFile* file,
+                                const ReadOptions& options,
+                                const BlockHandle& handle,
+                                BlockContents* result);
+
+// Like ReadBlockContents() above, but if the block is compressed, also
+// store its compressed bytes followed by its one-byte compression type
+// in *compressed, for UncompressBlockContents() to decode later.
+// *compressed is left empty for a block stored without compression.
+extern Status ReadBlockContents(RandomAccessFile* file,
+                                const ReadOptions& options,
+                                const BlockHandle& handle,
+                                BlockContents* result,
+                                std::string* compressed);
+
+// Decode "compressed", as stored by ReadBlockContents(), into *result.
+extern Status UncompressBlockContents(const Slice& compressed,
+                                      BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
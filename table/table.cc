@@ -4,33 +4,86 @@
 
 #include "leveldb/table.h"
 
+#include <vector>
 #include "leveldb/cache.h"
+#include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/prefix_extractor.h"
 #include "table/block.h"
+#include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
+// The key of a block in a block cache is the id the cache gave the
+// table, the table's file number and the block's offset, each encoded
+// as a fixed64.  The first two form the prefix.
+static const size_t kCacheKeyPrefixSize = 16;
+static const size_t kCacheKeySize = kCacheKeyPrefixSize + 8;
+
+static void EncodeCacheKeyPrefix(uint64_t cache_id, uint64_t file_number,
+                                 char* buf) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf + 8, file_number);
+}
+
+// Build the key of the block at "handle" in "buf", which must hold
+// kCacheKeySize bytes.
+static Slice CacheKey(const char* prefix, const BlockHandle& handle,
+                      char* buf) {
+  memcpy(buf, prefix, kCacheKeyPrefixSize);
+  EncodeFixed64(buf + kCacheKeyPrefixSize, handle.offset());
+  return Slice(buf, kCacheKeySize);
+}
+
 struct Table::Rep {
   ~Rep() {
+    delete filter;
+    delete [] filter_data;
     delete index_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
-  uint64_t cache_id;
+  // Prefixes of the keys of the table's blocks in options.block_cache
+  // and options.block_cache_compressed; see EncodeCacheKeyPrefix()
+  char cache_key_prefix[kCacheKeyPrefixSize];
+  char compressed_cache_key_prefix[kCacheKeyPrefixSize];
+  FilterBlockReader* filter;
+  const char* filter_data;
+  // Does filter hold the prefixes from options.prefix_extractor?
+  bool prefix_filter;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  bool partitioned_index;  // Does index_block point at index partitions?
 };
 
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
                    Table** table) {
+  // A table opened without a file number gets ids of its own, under
+  // which no other table caches blocks
+  return Open(options, file, size, 0,
+              (options.block_cache ? options.block_cache->NewId() : 0),
+              (options.block_cache_compressed
+               ? options.block_cache_compressed->NewId()
+               : 0),
+              table);
+}
+
+Status Table::Open(const Options& options,
+                   RandomAccessFile* file,
+                   uint64_t size,
+                   uint64_t file_number,
+                   uint64_t cache_id,
+                   uint64_t compressed_cache_id,
+                   Table** table) {
   *table = NULL;
   if (size < Footer::kEncodedLength) {
     return Status::InvalidArgument("file is too short to be an sstable");
@@ -60,8 +113,15 @@ Status Table::Open(const Options& options,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->partitioned_index = footer.partitioned_index();
+    EncodeCacheKeyPrefix(cache_id, file_number, rep->cache_key_prefix);
+    EncodeCacheKeyPrefix(compressed_cache_id, file_number,
+                         rep->compressed_cache_key_prefix);
+    rep->filter_data = NULL;
+    rep->filter = NULL;
+    rep->prefix_filter = false;
     *table = new Table(rep);
+    (*table)->ReadMeta(footer);
   } else {
     if (index_block) delete index_block;
   }
@@ -69,6 +129,56 @@ Status Table::Open(const Options& options,
   return s;
 }
 
+void Table::ReadMeta(const Footer& footer) {
+  if (rep_->options.filter_policy == NULL) {
+    return;  // Do not need any metadata
+  }
+
+  ReadOptions opt;
+  Block* meta = NULL;
+  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &meta).ok()) {
+    // Do not propagate errors since meta info is not needed for operation
+    return;
+  }
+
+  Iterator* iter = meta->NewIterator(BytewiseComparator());
+  std::string key = "filter.";
+  key.append(rep_->options.filter_policy->Name());
+  iter->Seek(key);
+  if (iter->Valid() && iter->key() == Slice(key)) {
+    ReadFilter(iter->value());
+  }
+  if (rep_->filter != NULL && rep_->options.prefix_extractor != NULL) {
+    key = "prefixextractor.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    rep_->prefix_filter = (iter->Valid() && iter->key() == Slice(key));
+  }
+  delete iter;
+  delete meta;
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // A table without a usable filter is still readable, so errors are
+  // ignored here as well.
+  ReadOptions opt;
+  BlockContents block;
+  if (!ReadBlockContents(rep_->file, opt, filter_handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->filter_data = block.data.data();  // Will need to delete later
+  }
+  rep_->filter = new FilterBlockReader(rep_->options.filter_policy,
+                                       block.data);
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -88,11 +198,116 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+static void DeleteCompressedBlock(const Slice& key, void* value) {
+  std::string* compressed = reinterpret_cast<std::string*>(value);
+  delete compressed;
+}
+
+// Read the contents of the block identified by "handle", going through
+// "compressed_cache" if it is non-NULL.
+static Status ReadBlockContentsCompressed(RandomAccessFile* file,
+                                          Cache* compressed_cache,
+                                          const char* compressed_key_prefix,
+                                          const ReadOptions& options,
+                                          const BlockHandle& handle,
+                                          BlockContents* contents) {
+  if (compressed_cache == NULL) {
+    return ReadBlockContents(file, options, handle, contents);
+  }
+
+  char cache_key_buffer[kCacheKeySize];
+  Slice key = CacheKey(compressed_key_prefix, handle, cache_key_buffer);
+  Cache::Handle* cache_handle = compressed_cache->Lookup(key);
+  if (cache_handle != NULL) {
+    const std::string* compressed =
+        reinterpret_cast<std::string*>(compressed_cache->Value(cache_handle));
+    Status s = UncompressBlockContents(*compressed, contents);
+    compressed_cache->Release(cache_handle);
+    return s;
+  }
+
+  std::string* compressed = new std::string;
+  Status s = ReadBlockContents(file, options, handle, contents, compressed);
+  if (s.ok() && !compressed->empty() && options.fill_cache) {
+    compressed_cache->Release(compressed_cache->Insert(
+        key, compressed, compressed->size(), &DeleteCompressedBlock));
+  } else {
+    delete compressed;
+  }
+  return s;
+}
+
+// Fetch the block identified by "handle", going through "block_cache"
+// if there is one, where a block that is read is inserted with
+// "priority".  Blocks missing from "block_cache" are looked for in
+// "compressed_cache" (if non-NULL) before the file is read.  On
+// success, the caller must release "*cache_handle" if it is non-NULL
+// and delete "*block" otherwise.
+static Status ReadDataBlock(RandomAccessFile* file,
+                            Cache* block_cache,
+                            const char* cache_key_prefix,
+                            Cache* compressed_cache,
+                            const char* compressed_key_prefix,
+                            const ReadOptions& options,
+                            const BlockHandle& handle,
+                            Cache::Priority priority,
+                            Block** block,
+                            Cache::Handle** cache_handle) {
+  *block = NULL;
+  *cache_handle = NULL;
+  Status s;
+  if (block_cache != NULL) {
+    char cache_key_buffer[kCacheKeySize];
+    Slice key = CacheKey(cache_key_prefix, handle, cache_key_buffer);
+    *cache_handle = block_cache->Lookup(key);
+    if (*cache_handle != NULL) {
+      *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
+    } else {
+      BlockContents contents;
+      s = ReadBlockContentsCompressed(file, compressed_cache,
+                                      compressed_key_prefix, options, handle,
+                                      &contents);
+      if (s.ok()) {
+        *block = new Block(contents);
+        if (contents.cachable && options.fill_cache) {
+          *cache_handle = block_cache->Insert(
+              key, *block, (*block)->size(), &DeleteCachedBlock, priority);
+        }
+      }
+    }
+  } else {
+    BlockContents contents;
+    s = ReadBlockContentsCompressed(file, compressed_cache,
+                                    compressed_key_prefix, options, handle,
+                                    &contents);
+    if (s.ok()) {
+      *block = new Block(contents);
+    }
+  }
+  return s;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
+  return BlockReader(arg, options, index_value, false);
+}
+
+// Like BlockReader, but for the blocks of a partitioned index, which
+// are read for every lookup in the table and so are worth more in the
+// block cache than data blocks.
+Iterator* Table::IndexPartitionReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  return BlockReader(arg, options, index_value, true);
+}
+
+Iterator* Table::BlockReader(void* arg,
+                             const ReadOptions& options,
+                             const Slice& index_value,
+                             bool high_priority) {
   Table* table = reinterpret_cast<Table*>(arg);
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = NULL;
@@ -105,24 +320,14 @@ Iterator* Table::BlockReader(void* arg,
   // can add more features in the future.
 
   if (s.ok()) {
-    if (block_cache != NULL) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &block);
-        if (s.ok() && options.fill_cache) {
-          cache_handle = block_cache->Insert(
-              key, block, block->size(), &DeleteCachedBlock);
-        }
-      }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &block);
-    }
+    s = ReadDataBlock(table->rep_->file, block_cache,
+                      table->rep_->cache_key_prefix,
+                      table->rep_->options.block_cache_compressed,
+                      table->rep_->compressed_cache_key_prefix,
+                      options, handle,
+                      high_priority ? Cache::kHighPriority
+                                    : Cache::kNormalPriority,
+                      &block, &cache_handle);
   }
 
   Iterator* iter;
@@ -139,15 +344,212 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->partitioned_index) {
+    // Index partitions are blocks of index entries, so they are read
+    // the same way as data blocks, though cached with high priority
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+      NewIndexIterator(options),
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+namespace {
+// An index entry, kept past the end of Block::Get()
+struct IndexEntry {
+  bool found;
+  std::string* key;    // If non-NULL, receives the entry's key
+  BlockHandle handle;
+  Status status;       // Result of decoding the handle
+};
+}
+
+static void SaveIndexEntry(void* arg, const Slice& k, const Slice& v) {
+  IndexEntry* entry = reinterpret_cast<IndexEntry*>(arg);
+  entry->found = true;
+  if (entry->key != NULL) {
+    entry->key->assign(k.data(), k.size());
+  }
+  Slice input = v;
+  entry->status = entry->handle.DecodeFrom(&input);
+}
+
+Status Table::FindDataBlock(const ReadOptions& options, const Slice& k,
+                            bool* found, BlockHandle* handle,
+                            std::string* index_key) const {
+  const Comparator* comparator = rep_->options.comparator;
+  IndexEntry entry;
+  entry.found = false;
+  entry.key = index_key;
+  Status s = rep_->index_block->Get(comparator, k, &entry, &SaveIndexEntry);
+  if (s.ok() && entry.found) {
+    s = entry.status;
+  }
+  if (s.ok() && entry.found && rep_->partitioned_index) {
+    // The entry locates the index partition that holds the one we want.
+    // Its key bounds the partition's keys, so the search cannot miss.
+    Cache* block_cache = rep_->options.block_cache;
+    Block* partition;
+    Cache::Handle* cache_handle;
+    s = ReadDataBlock(rep_->file, block_cache, rep_->cache_key_prefix,
+                      rep_->options.block_cache_compressed,
+                      rep_->compressed_cache_key_prefix, options, entry.handle,
+                      Cache::kHighPriority, &partition, &cache_handle);
+    if (s.ok()) {
+      entry.found = false;
+      s = partition->Get(comparator, k, &entry, &SaveIndexEntry);
+      if (s.ok() && entry.found) {
+        s = entry.status;
+      }
+      if (cache_handle != NULL) {
+        block_cache->Release(cache_handle);
+      } else {
+        delete partition;
+      }
+    }
+  }
+  *found = s.ok() && entry.found;
+  if (*found) {
+    *handle = entry.handle;
+  }
+  return s;
+}
+
+Status Table::InternalGet(const ReadOptions& options, const Slice& k,
+                          void* arg,
+                          void (*saver)(void*, const Slice&, const Slice&)) {
+  const Comparator* comparator = rep_->options.comparator;
+  bool found;
+  BlockHandle handle;
+  Status s = FindDataBlock(options, k, &found, &handle, NULL);
+  if (!found) {
+    return s;  // Error, or key is past the last block
+  }
+
+  FilterBlockReader* filter = rep_->filter;
+  if (filter != NULL && !filter->KeyMayMatch(handle.offset(), k)) {
+    return s;  // Not found
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  Block* block;
+  Cache::Handle* cache_handle;
+  s = ReadDataBlock(rep_->file, block_cache, rep_->cache_key_prefix,
+                    rep_->options.block_cache_compressed,
+                    rep_->compressed_cache_key_prefix, options, handle,
+                    Cache::kNormalPriority, &block, &cache_handle);
+  if (s.ok()) {
+    s = block->Get(comparator, k, arg, saver);
+    if (cache_handle != NULL) {
+      block_cache->Release(cache_handle);
+    } else {
+      delete block;
+    }
+  }
+  return s;
+}
+
+bool Table::PrefixMayMatch(const ReadOptions& options,
+                           const Slice& probe) const {
+  const PrefixExtractor* prefix_extractor = rep_->options.prefix_extractor;
+  FilterBlockReader* filter = rep_->filter;
+  if (filter == NULL || prefix_extractor == NULL || !rep_->prefix_filter ||
+      !prefix_extractor->InDomain(probe)) {
+    return true;
+  }
+  const Slice prefix = prefix_extractor->Transform(probe);
+
+  // Keys with the prefix are adjacent, so they lie in the block the
+  // probe seeks to and in any following blocks whose predecessors'
+  // index keys still carry the prefix.
+  Iterator* index_iter = NewIndexIterator(options);
+  bool may_match = false;
+  for (index_iter->Seek(probe); index_iter->Valid(); index_iter->Next()) {
+    Slice handle_value = index_iter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok() ||
+        filter->KeyMayMatch(handle.offset(), probe)) {
+      may_match = true;
+      break;
+    }
+    const Slice index_key = index_iter->key();
+    if (!prefix_extractor->InDomain(index_key) ||
+        prefix_extractor->Transform(index_key) != prefix) {
+      break;
+    }
+  }
+  if (!index_iter->status().ok()) {
+    may_match = true;
+  }
+  delete index_iter;
+  return may_match;
+}
+
+Status Table::InternalMultiGet(
+    const ReadOptions& options, int n, const Slice* keys, void* const* args,
+    void (*saver)(void*, const Slice&, const Slice&)) {
+  const Comparator* comparator = rep_->options.comparator;
+  Cache* block_cache = rep_->options.block_cache;
+  FilterBlockReader* filter = rep_->filter;
+  std::vector<int> matches;
+  std::string index_key;
+  BlockHandle handle;
+  Status s;
+  int i = 0;
+  while (s.ok() && i < n) {
+    bool found;
+    s = FindDataBlock(options, keys[i], &found, &handle, &index_key);
+    if (!found) {
+      break;  // Error, or this key and all later ones are past the last block
+    }
+
+    // The index entry's key separates its block from the next one, so
+    // every key up to it belongs to the same block.
+    int end = i + 1;
+    while (end < n && comparator->Compare(keys[end], index_key) <= 0) {
+      end++;
+    }
+
+    matches.clear();
+    for (int j = i; j < end; j++) {
+      if (filter == NULL || filter->KeyMayMatch(handle.offset(), keys[j])) {
+        matches.push_back(j);
+      }
+    }
+    i = end;
+    if (matches.empty()) {
+      continue;  // Not found
+    }
+
+    Block* block;
+    Cache::Handle* cache_handle;
+    s = ReadDataBlock(rep_->file, block_cache, rep_->cache_key_prefix,
+                      rep_->options.block_cache_compressed,
+                      rep_->compressed_cache_key_prefix, options, handle,
+                      Cache::kNormalPriority, &block, &cache_handle);
+    if (s.ok()) {
+      for (size_t j = 0; s.ok() && j < matches.size(); j++) {
+        s = block->Get(comparator, keys[matches[j]], args[matches[j]], saver);
+      }
+      if (cache_handle != NULL) {
+        block_cache->Release(cache_handle);
+      } else {
+        delete block;
+      }
+    }
+  }
+  return s;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -172,4 +574,47 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+void Table::EraseBlock(const Slice& index_value) const {
+  BlockHandle handle;
+  Slice input = index_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return;
+  }
+  char cache_key_buffer[kCacheKeySize];
+  if (rep_->options.block_cache != NULL) {
+    rep_->options.block_cache->Erase(
+        CacheKey(rep_->cache_key_prefix, handle, cache_key_buffer));
+  }
+  if (rep_->options.block_cache_compressed != NULL) {
+    rep_->options.block_cache_compressed->Erase(
+        CacheKey(rep_->compressed_cache_key_prefix, handle,
+                 cache_key_buffer));
+  }
+}
+
+void Table::EraseCachedBlocks() const {
+  if (rep_->options.block_cache == NULL &&
+      rep_->options.block_cache_compressed == NULL) {
+    return;
+  }
+
+  // Erase the data blocks first, since finding them may read index
+  // partitions through the caches
+  ReadOptions options;
+  options.fill_cache = false;
+  Iterator* iter = NewIndexIterator(options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    EraseBlock(iter->value());
+  }
+  delete iter;
+
+  if (rep_->partitioned_index) {
+    iter = rep_->index_block->NewIterator(rep_->options.comparator);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      EraseBlock(iter->value());
+    }
+    delete iter;
+  }
+}
+
 }  // namespace leveldb
@@ -6,9 +6,13 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/prefix_extractor.h"
 #include "table/block_builder.h"
+#include "table/filter_block.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
@@ -27,6 +31,7 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
+  FilterBlockBuilder* filter_block;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -40,6 +45,13 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // With options.index_partition_size set, index_block holds the index
+  // partition being built.  Finished partitions are kept here until
+  // Finish() writes them after the data blocks, where they cannot shift
+  // the data block offsets that the filter block is keyed by.
+  std::vector<std::string> index_partitions;
+  std::vector<std::string> index_partition_keys;  // Last key of each
+
   std::string compressed_output;
 
   Rep(const Options& opt, WritableFile* f)
@@ -51,17 +63,24 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
+        filter_block(opt.filter_policy == NULL ? NULL
+                     : new FilterBlockBuilder(opt.filter_policy)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
   }
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
     : rep_(new Rep(options, file)) {
+  if (rep_->filter_block != NULL) {
+    rep_->filter_block->StartBlock(0);
+  }
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  delete rep_->filter_block;
   delete rep_;
 }
 
@@ -78,6 +97,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -92,10 +112,11 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddIndexEntry();
+  }
+
+  if (r->filter_block != NULL) {
+    r->filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -119,16 +140,46 @@ void TableBuilder::Flush() {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
+  if (r->filter_block != NULL) {
+    r->filter_block->StartBlock(r->offset);
+  }
+}
+
+void TableBuilder::AddIndexEntry() {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  r->pending_handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(r->last_key, Slice(handle_encoding));
+  r->pending_index_entry = false;
+
+  if (r->options.index_partition_size > 0 &&
+      r->index_block.CurrentSizeEstimate() >= r->options.index_partition_size) {
+    FinishIndexPartition();
+  }
+}
+
+void TableBuilder::FinishIndexPartition() {
+  // The partition's last key is the one its entry in the top-level
+  // index needs: it is >= all keys in the partition's data blocks and
+  // < all keys in later ones.
+  Rep* r = rep_;
+  r->index_partitions.push_back(r->index_block.Finish().ToString());
+  r->index_partition_keys.push_back(r->last_key);
+  r->index_block.Reset();
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  WriteBlock(block->Finish(), handle);
+  block->Reset();
+}
+
+void TableBuilder::WriteBlock(const Slice& raw, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
@@ -152,6 +203,14 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
       break;
     }
   }
+  WriteRawBlock(block_contents, type, handle);
+  r->compressed_output.clear();
+}
+
+void TableBuilder::WriteRawBlock(const Slice& block_contents,
+                                 CompressionType type,
+                                 BlockHandle* handle) {
+  Rep* r = rep_;
   handle->set_offset(r->offset);
   handle->set_size(block_contents.size());
   r->status = r->file->Append(block_contents);
@@ -166,8 +225,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
       r->offset += block_contents.size() + kBlockTrailerSize;
     }
   }
-  r->compressed_output.clear();
-  block->Reset();
 }
 
 Status TableBuilder::status() const {
@@ -179,27 +236,74 @@ Status TableBuilder::Finish() {
   Flush();
   assert(!r->closed);
   r->closed = true;
-  BlockHandle metaindex_block_handle;
-  BlockHandle index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+
+  // Write filter block
+  if (ok() && r->filter_block != NULL) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
+
+  // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    BlockBuilder meta_index_block(&r->index_block_options);
+    if (r->filter_block != NULL) {
+      // Add mapping from "filter.Name" to location of filter data
+      std::string key = "filter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+
+      if (r->options.prefix_extractor != NULL) {
+        // Record that the filter holds the prefixes from this extractor.
+        // Sorts after "filter.*".
+        key = "prefixextractor.";
+        key.append(r->options.prefix_extractor->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
+
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
+  bool partitioned_index = false;
   if (ok()) {
     if (r->pending_index_entry) {
       r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      AddIndexEntry();
+    }
+    if (r->options.index_partition_size == 0 &&
+        r->index_partitions.empty()) {
+      WriteBlock(&r->index_block, &index_block_handle);
+    } else {
+      // Write the index partitions followed by the top-level index,
+      // which maps the last key of each partition to its location
+      partitioned_index = true;
+      if (!r->index_block.empty()) {
+        FinishIndexPartition();
+      }
+      BlockBuilder top_level_index(&r->index_block_options);
+      for (size_t i = 0; ok() && i < r->index_partitions.size(); i++) {
+        BlockHandle partition_handle;
+        WriteBlock(r->index_partitions[i], &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        top_level_index.Add(r->index_partition_keys[i],
+                            Slice(handle_encoding));
+      }
+      r->index_partitions.clear();
+      r->index_partition_keys.clear();
+      if (ok()) {
+        WriteBlock(&top_level_index, &index_block_handle);
+      }
     }
-    WriteBlock(&r->index_block, &index_block_handle);
   }
   if (ok()) {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(partitioned_index);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
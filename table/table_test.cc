@@ -9,7 +9,9 @@
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/memtable.h"
+#include "db/table_cache.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -111,15 +113,19 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()), reads_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
 
+  // Number of calls to Read() so far
+  int reads() const { return reads_; }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
+    reads_++;
     if (offset > contents_.size()) {
       return Status::InvalidArgument("invalid Read offset");
     }
@@ -133,6 +139,7 @@ class StringSource: public RandomAccessFile {
 
  private:
   std::string contents_;
+  mutable int reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -177,6 +184,13 @@ class Constructor {
 
   virtual DB* db() const { return NULL; }  // Overridden in DBConstructor
 
+  // Look up the first entry at or after "target" without an iterator and
+  // store it in "*result" in the format used by Harness::ToString().
+  // Returns false if this constructor has no such lookup path.
+  virtual bool PointLookup(const Slice& target, std::string* result) const {
+    return false;
+  }
+
  private:
   KVMap data_;
 };
@@ -206,7 +220,11 @@ class BlockConstructor: public Constructor {
     block_size_ = block_data.size();
     char* block_data_copy = new char[block_size_];
     memcpy(block_data_copy, block_data.data(), block_size_);
-    block_ = new Block(block_data_copy, block_size_);
+    BlockContents contents;
+    contents.data = Slice(block_data_copy, block_size_);
+    contents.cachable = false;
+    contents.heap_allocated = true;
+    block_ = new Block(contents);
     return Status::OK();
   }
   virtual size_t NumBytes() const { return block_size_; }
@@ -215,7 +233,19 @@ class BlockConstructor: public Constructor {
     return block_->NewIterator(comparator_);
   }
 
+  virtual bool PointLookup(const Slice& target, std::string* result) const {
+    *result = "END";
+    Status s = block_->Get(comparator_, target, result, &SaveEntry);
+    ASSERT_TRUE(s.ok()) << s.ToString();
+    return true;
+  }
+
  private:
+  static void SaveEntry(void* arg, const Slice& k, const Slice& v) {
+    *reinterpret_cast<std::string*>(arg) =
+        "'" + k.ToString() + "->" + v.ToString() + "'";
+  }
+
   const Comparator* comparator_;
   int block_size_;
   Block* block_;
@@ -424,6 +454,7 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  size_t index_partition_size;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -434,6 +465,13 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
 
+  // Tables with a partitioned index, from one index entry per partition
+  // up to several
+  { TABLE_TEST, false, 16, 1 },
+  { TABLE_TEST, false, 16, 100 },
+  { TABLE_TEST, true, 16, 1 },
+  { TABLE_TEST, true, 16, 100 },
+
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
   { BLOCK_TEST, false, 1024 },
@@ -464,6 +502,7 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.index_partition_size = args.index_partition_size;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -499,6 +538,7 @@ class Harness {
     TestForwardScan(keys, data);
     TestBackwardScan(keys, data);
     TestRandomAccess(rnd, keys, data);
+    TestPointLookups(rnd, keys, data);
   }
 
   void TestForwardScan(const std::vector<std::string>& keys,
@@ -601,6 +641,19 @@ class Harness {
     delete iter;
   }
 
+  void TestPointLookups(Random* rnd,
+                        const std::vector<std::string>& keys,
+                        const KVMap& data) {
+    std::string result;
+    for (int i = 0; i < 100; i++) {
+      std::string key = PickRandomKey(rnd, keys);
+      if (!constructor_->PointLookup(key, &result)) {
+        return;
+      }
+      ASSERT_EQ(ToString(data, data.lower_bound(key)), result);
+    }
+  }
+
   std::string ToString(const KVMap& data, const KVMap::const_iterator& it) {
     if (it == data.end()) {
       return "END";
@@ -814,6 +867,33 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitionedIndex) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.index_partition_size = 1;
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"),   10000,  11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04a"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"),  510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"),  510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),  610000, 611000));
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -848,6 +928,249 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+TEST(TableTest, CompressedBlockCache) {
+  if (!SnappyCompressionSupported()) {
+    fprintf(stderr, "skipping compression tests\n");
+    return;
+  }
+
+  Random rnd(301);
+  Options options;
+  options.block_size = 1024;
+  options.compression = kSnappyCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  std::vector<std::string> values(100);
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%03d", i);
+    test::CompressibleString(&rnd, 0.25, 1000, &values[i]);
+    builder.Add(key, values[i]);
+  }
+  ASSERT_OK(builder.Finish());
+
+  // Every block misses in the block cache, which holds nothing, so
+  // reads after the first are served by the compressed block cache.
+  StringSource source(sink.contents());
+  Options table_options;
+  table_options.block_cache = NewLRUCache(0);
+  table_options.block_cache_compressed = NewLRUCache(1 << 20);
+  Table* table;
+  ASSERT_OK(Table::Open(table_options, &source, source.Size(), &table));
+  const int open_reads = source.reads();
+  int file_reads = 0;  // Reads made by one pass over the table
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_EQ(values[i], iter->value().ToString());
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(100, i);
+    delete iter;
+    if (pass == 0) {
+      file_reads = source.reads() - open_reads;
+    }
+  }
+  ASSERT_GT(file_reads, 0);
+  ASSERT_EQ(open_reads + file_reads, source.reads());
+
+  // Reads that do not fill the caches leave the compressed cache
+  // alone, so they go to the file.
+  delete table;
+  delete table_options.block_cache_compressed;
+  table_options.block_cache_compressed = NewLRUCache(1 << 20);
+  ASSERT_OK(Table::Open(table_options, &source, source.Size(), &table));
+  ReadOptions no_fill;
+  no_fill.fill_cache = false;
+  const int reads_before = source.reads();
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = table->NewIterator(no_fill);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+  ASSERT_EQ(reads_before + 2 * file_reads, source.reads());
+
+  delete table;
+  delete table_options.block_cache;
+  delete table_options.block_cache_compressed;
+}
+
+class BlockHashIndexTest {
+ public:
+  InternalKeyComparator icmp_;
+  Options options_;
+  Block* block_;
+  std::vector<std::string> keys_;
+
+  BlockHashIndexTest() : icmp_(BytewiseComparator()), block_(NULL) {
+    options_.comparator = &icmp_;
+    options_.data_block_hash_index = true;
+  }
+
+  ~BlockHashIndexTest() {
+    delete block_;
+  }
+
+  // Build a block holding versions 1..(i%3)+1 of user key i for i in
+  // [0,n), and report whether it got a hash index.
+  bool Build(int n) {
+    keys_.clear();
+    BlockBuilder builder(&options_);
+    char buf[100];
+    for (int i = 0; i < n; i++) {
+      snprintf(buf, sizeof(buf), "key%06d", i * 2);
+      for (int seq = (i % 3) + 1; seq >= 1; seq--) {
+        std::string ikey;
+        AppendInternalKey(&ikey, ParsedInternalKey(buf, seq, kTypeValue));
+        builder.Add(ikey, buf);
+        keys_.push_back(ikey);
+      }
+    }
+    Slice raw = builder.Finish();
+    char* copy = new char[raw.size()];
+    memcpy(copy, raw.data(), raw.size());
+    BlockContents contents;
+    contents.data = Slice(copy, raw.size());
+    contents.cachable = false;
+    contents.heap_allocated = true;
+    delete block_;
+    block_ = new Block(contents);
+    return (DecodeFixed32(copy + raw.size() - 4) &
+            kBlockHashIndexFlag) != 0;
+  }
+
+  static void SaveKey(void* arg, const Slice& k, const Slice& v) {
+    *reinterpret_cast<std::string*>(arg) = k.ToString();
+  }
+
+  std::string Get(const std::string& user_key, SequenceNumber seq) {
+    std::string ikey, result;
+    AppendInternalKey(&ikey, ParsedInternalKey(user_key, seq, kTypeValue));
+    Status s = block_->Get(&icmp_, ikey, &result, &SaveKey);
+    ASSERT_TRUE(s.ok()) << s.ToString();
+    return result;
+  }
+
+  std::string Seek(const std::string& user_key, SequenceNumber seq) {
+    std::string ikey;
+    AppendInternalKey(&ikey, ParsedInternalKey(user_key, seq, kTypeValue));
+    Iterator* iter = block_->NewIterator(&icmp_);
+    iter->Seek(ikey);
+    std::string result = iter->Valid() ? iter->key().ToString() : "";
+    delete iter;
+    return result;
+  }
+
+  void Check(int n) {
+    // Every entry is still there for iterators
+    Iterator* iter = block_->NewIterator(&icmp_);
+    size_t count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), count++) {
+      ASSERT_LT(count, keys_.size());
+      ASSERT_EQ(keys_[count], iter->key().ToString());
+    }
+    ASSERT_EQ(keys_.size(), count);
+    delete iter;
+
+    char buf[100];
+    for (int i = 0; i < n; i++) {
+      snprintf(buf, sizeof(buf), "key%06d", i * 2);
+      for (SequenceNumber seq = 0; seq <= 4; seq++) {
+        const std::string expected = Seek(buf, seq);
+        if (!expected.empty() && ExtractUserKey(expected) == Slice(buf)) {
+          ASSERT_EQ(expected, Get(buf, seq));
+        }
+      }
+
+      // Absent user keys find nothing, or an entry for another user key
+      snprintf(buf, sizeof(buf), "key%06d", i * 2 + 1);
+      const std::string found = Get(buf, kMaxSequenceNumber);
+      ASSERT_TRUE(found.empty() || ExtractUserKey(found) != Slice(buf));
+    }
+  }
+};
+
+TEST(BlockHashIndexTest, Lookups) {
+  for (int n = 1; n < 500; n += (n < 20 ? 1 : 37)) {
+    ASSERT_TRUE(Build(n));
+    Check(n);
+  }
+}
+
+TEST(BlockHashIndexTest, RestartPerEntry) {
+  options_.block_restart_interval = 1;
+  ASSERT_TRUE(Build(50));
+  Check(50);
+}
+
+TEST(BlockHashIndexTest, TooManyRestarts) {
+  // More restart points than a bucket can name: no hash index
+  options_.block_restart_interval = 1;
+  ASSERT_TRUE(!Build(200));
+  Check(200);
+}
+
+TEST(BlockHashIndexTest, Disabled) {
+  options_.data_block_hash_index = false;
+  ASSERT_TRUE(!Build(100));
+  Check(100);
+}
+
+// Point lookups in a table reach the hash index through
+// Table::InternalGet(), which TableCache::Get() calls.
+TEST(BlockHashIndexTest, TableLookups) {
+  Env* env = Env::Default();
+  const std::string dbname = PathJoin(test::TmpDir(), "block_hash_index_test");
+  env->CreateDir(dbname);
+  const std::string fname = TableFileName(dbname, 1);
+  WritableFile* file;
+  ASSERT_OK(env->NewWritableFile(fname, &file));
+  options_.block_size = 256;
+  TableBuilder builder(options_, file);
+  const int n = 500;
+  char buf[100];
+  for (int i = 0; i < n; i++) {
+    snprintf(buf, sizeof(buf), "key%06d", i * 2);
+    for (int seq = (i % 3) + 1; seq >= 1; seq--) {
+      std::string ikey;
+      AppendInternalKey(&ikey, ParsedInternalKey(buf, seq, kTypeValue));
+      builder.Add(ikey, buf);
+    }
+  }
+  ASSERT_OK(builder.Finish());
+  ASSERT_OK(file->Close());
+  delete file;
+  uint64_t file_size;
+  ASSERT_OK(env->GetFileSize(fname, &file_size));
+
+  TableCache cache(dbname, &options_, 10);
+  Iterator* iter = cache.NewIterator(ReadOptions(), 1, file_size, 0);
+  for (int i = 0; i < 2 * n; i++) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    for (SequenceNumber seq = 0; seq <= 4; seq++) {
+      std::string ikey, found;
+      AppendInternalKey(&ikey, ParsedInternalKey(buf, seq, kTypeValue));
+      ASSERT_OK(cache.Get(ReadOptions(), 1, file_size, 0, ikey, &found,
+                          &SaveKey));
+      iter->Seek(ikey);
+      if (iter->Valid() && ExtractUserKey(iter->key()) == Slice(buf)) {
+        ASSERT_EQ(iter->key().ToString(), found);
+      } else {
+        // No entry for the user key: nothing, or one for another key
+        ASSERT_TRUE(found.empty() || ExtractUserKey(found) != Slice(buf));
+      }
+    }
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  env->DeleteFile(fname);
+  env->DeleteDir(dbname);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -16,12 +16,21 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
+void Cache::GetShardStats(std::vector<CacheShardStats>* stats) {
+}
+
 namespace {
 
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in circular doubly linked lists ordered by access time.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +41,7 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool in_protected;  // Whether the entry is on the protected list
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -133,56 +143,90 @@ class HandleTable {
 };
 
 // A single shard of sharded cache.
+//
+// The shard is a segmented LRU cache.  New entries go on the probation
+// list, and move to the protected list when they are looked up.  When
+// the protected list outgrows its capacity, its oldest entries move
+// back to the newest end of the probation list.  Entries are evicted
+// from the oldest end of the probation list, so entries that are used
+// only once, such as the blocks read by a scan, evict each other
+// rather than entries that were used again.
+//
+// With a protected capacity of zero, every entry that is looked up
+// passes straight back to the newest end of the probation list, which
+// makes the shard a plain LRU cache.
 class LRUCache {
  public:
   LRUCache();
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t protected_capacity) {
+    capacity_ = capacity;
+    protected_capacity_ = protected_capacity;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  void GetStats(CacheShardStats* stats);
 
  private:
   void LRU_Remove(LRUHandle* e);
-  void LRU_Append(LRUHandle* e);
+  void LRU_Append(LRUHandle* list, LRUHandle* e);
   void Unref(LRUHandle* e);
 
+  // Move the oldest protected entries to the probation list until the
+  // protected list fits in its capacity.
+  void DemoteProtected();
+
   // Initialized before use.
   size_t capacity_;
+  size_t protected_capacity_;
 
   // mutex_ protects the following state.
   port::Mutex mutex_;
   size_t usage_;
+  size_t protected_usage_;  // Combined charge of the protected entries
   uint64_t last_id_;
+  uint64_t hits_;
+  uint64_t misses_;
 
-  // Dummy head of LRU list.
-  // lru.prev is newest entry, lru.next is oldest entry.
-  LRUHandle lru_;
+  // Dummy heads of the LRU lists.
+  // list.prev is newest entry, list.next is oldest entry.
+  LRUHandle probation_;
+  LRUHandle protected_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
     : usage_(0),
-      last_id_(0) {
-  // Make empty circular linked list
-  lru_.next = &lru_;
-  lru_.prev = &lru_;
+      protected_usage_(0),
+      last_id_(0),
+      hits_(0),
+      misses_(0) {
+  // Make empty circular linked lists
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
+  protected_.next = &protected_;
+  protected_.prev = &protected_;
 }
 
 LRUCache::~LRUCache() {
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->refs == 1);  // Error if caller has an unreleased handle
-    Unref(e);
-    e = next;
+  LRUHandle* lists[2] = { &probation_, &protected_ };
+  for (int i = 0; i < 2; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->refs == 1);  // Error if caller has an unreleased handle
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -199,27 +243,55 @@ void LRUCache::Unref(LRUHandle* e) {
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_protected) {
+    protected_usage_ -= e->charge;
+  }
 }
 
-void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
+  // Make "e" newest entry by inserting just before *list
+  e->next = list;
+  e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
+  e->in_protected = (list == &protected_);
+  if (e->in_protected) {
+    protected_usage_ += e->charge;
+  }
+}
+
+void LRUCache::DemoteProtected() {
+  while (protected_usage_ > protected_capacity_) {
+    LRUHandle* old = protected_.next;
+    assert(old != &protected_);
+    LRU_Remove(old);
+    LRU_Append(&probation_, old);
+  }
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != NULL) {
+    hits_++;
     e->refs++;
     LRU_Remove(e);
-    LRU_Append(e);
+    LRU_Append(&protected_, e);
+    DemoteProtected();
+  } else {
+    misses_++;
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
+void LRUCache::GetStats(CacheShardStats* stats) {
+  MutexLock l(&mutex_);
+  stats->hits = hits_;
+  stats->misses = misses_;
+  stats->usage = usage_;
+  stats->capacity = capacity_;
+}
+
 void LRUCache::Release(Cache::Handle* handle) {
   MutexLock l(&mutex_);
   Unref(reinterpret_cast<LRUHandle*>(handle));
@@ -227,7 +299,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -239,7 +312,11 @@ Cache::Handle* LRUCache::Insert(
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
   memcpy(e->key_data, key.data(), key.size());
-  LRU_Append(e);
+  if (priority == Cache::kHighPriority) {
+    LRU_Append(&protected_, e);
+  } else {
+    LRU_Append(&probation_, e);
+  }
   usage_ += charge;
 
   LRUHandle* old = table_.Insert(e);
@@ -247,9 +324,18 @@ Cache::Handle* LRUCache::Insert(
     LRU_Remove(old);
     Unref(old);
   }
-
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  DemoteProtected();
+
+  while (usage_ > capacity_) {
+    // Evict probation entries first, and protected ones only when
+    // the probation list is empty
+    LRUHandle* old = probation_.next;
+    if (old == &probation_) {
+      old = protected_.next;
+      if (old == &protected_) {
+        break;
+      }
+    }
     LRU_Remove(old);
     table_.Remove(old->key(), old->hash);
     Unref(old);
@@ -267,12 +353,13 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+static const int kDefaultNumShardBits = 4;
+static const double kNoProtectedFraction = 0.0;
 
 class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  const int num_shard_bits_;
+  LRUCache* shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -280,23 +367,39 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) {
-    return hash >> (32 - kNumShardBits);
+  uint32_t Shard(uint32_t hash) const {
+    // The top bits of the hash pick the shard, leaving the low bits,
+    // which pick hash table buckets, to vary within a shard.
+    return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
-      : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  ShardedLRUCache(size_t capacity, int num_shard_bits,
+                  double protected_fraction)
+      : num_shard_bits_(num_shard_bits),
+        shard_(new LRUCache[1 << num_shard_bits]),
+        last_id_(0) {
+    const int num_shards = 1 << num_shard_bits_;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    const size_t protected_per_shard =
+        static_cast<size_t>(per_shard * protected_fraction);
+    for (int s = 0; s < num_shards; s++) {
+      shard_[s].SetCapacity(per_shard, protected_per_shard);
     }
   }
-  virtual ~ShardedLRUCache() { }
+  virtual ~ShardedLRUCache() {
+    delete[] shard_;
+  }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kNormalPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
@@ -317,12 +420,33 @@ class ShardedLRUCache : public Cache {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
+  virtual void GetShardStats(std::vector<CacheShardStats>* stats) {
+    const int num_shards = 1 << num_shard_bits_;
+    for (int s = 0; s < num_shards; s++) {
+      CacheShardStats shard_stats;
+      shard_[s].GetStats(&shard_stats);
+      stats->push_back(shard_stats);
+    }
+  }
 };
 
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return new ShardedLRUCache(capacity, kDefaultNumShardBits,
+                             kNoProtectedFraction);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  assert(num_shard_bits >= 0 && num_shard_bits <= 20);
+  return new ShardedLRUCache(capacity, num_shard_bits, kNoProtectedFraction);
+}
+
+Cache* NewSegmentedLRUCache(size_t capacity, int num_shard_bits,
+                            double protected_fraction) {
+  assert(num_shard_bits >= 0 && num_shard_bits <= 20);
+  assert(protected_fraction >= 0.0 && protected_fraction < 1.0);
+  return new ShardedLRUCache(capacity, num_shard_bits, protected_fraction);
 }
 
 }  // namespace leveldb
@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -59,124 +63,382 @@ class CacheTest {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), 1,
+                                   &CacheTest::Deleter,
+                                   Cache::kHighPriority));
+  }
+
   void Erase(int key) {
     cache_->Erase(EncodeKey(key));
   }
-};
-CacheTest* CacheTest::current_;
 
-TEST(CacheTest, HitAndMiss) {
-  ASSERT_EQ(-1, Lookup(100));
+  void TestHitAndMiss() {
+    ASSERT_EQ(-1, Lookup(100));
 
-  Insert(100, 101);
-  ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(-1,  Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1,  Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
 
-  Insert(200, 201);
-  ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
+    Insert(200, 201);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
 
-  Insert(100, 102);
-  ASSERT_EQ(102, Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
+    Insert(100, 102);
+    ASSERT_EQ(102, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
 
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
-}
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+  }
 
-TEST(CacheTest, Erase) {
-  Erase(200);
-  ASSERT_EQ(0, deleted_keys_.size());
+  void TestErase() {
+    Erase(200);
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    Insert(100, 101);
+    Insert(200, 201);
+    Erase(100);
+    ASSERT_EQ(-1,  Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1,  Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+  }
 
-  Insert(100, 101);
-  Insert(200, 201);
-  Erase(100);
-  ASSERT_EQ(-1,  Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
-
-  Erase(100);
-  ASSERT_EQ(-1,  Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(1, deleted_keys_.size());
-}
+  void TestEntriesArePinned() {
+    Insert(100, 101);
+    Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+    Insert(100, 102);
+    Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    cache_->Release(h1);
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(1, deleted_keys_.size());
+
+    cache_->Release(h2);
+    ASSERT_EQ(2, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[1]);
+    ASSERT_EQ(102, deleted_values_[1]);
+  }
 
-TEST(CacheTest, EntriesArePinned) {
-  Insert(100, 101);
-  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
-  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+  void TestEvictionPolicy() {
+    Insert(100, 101);
+    Insert(200, 201);
 
-  Insert(100, 102);
-  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
-  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
-  ASSERT_EQ(0, deleted_keys_.size());
+    // Frequently used entry must be kept around
+    for (int i = 0; i < kCacheSize + 100; i++) {
+      Insert(1000+i, 2000+i);
+      ASSERT_EQ(2000+i, Lookup(1000+i));
+      ASSERT_EQ(101, Lookup(100));
+    }
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+  }
 
-  cache_->Release(h1);
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
+  void TestHeavyEntries() {
+    // Add a bunch of light and heavy entries and then count the combined
+    // size of items still in the cache, which must be approximately the
+    // same as the total capacity.
+    const int kLight = 1;
+    const int kHeavy = 10;
+    int added = 0;
+    int index = 0;
+    while (added < 2*kCacheSize) {
+      const int weight = (index & 1) ? kLight : kHeavy;
+      Insert(index, 1000+index, weight);
+      added += weight;
+      index++;
+    }
+
+    int cached_weight = 0;
+    for (int i = 0; i < index; i++) {
+      const int weight = (i & 1 ? kLight : kHeavy);
+      int r = Lookup(i);
+      if (r >= 0) {
+        cached_weight += weight;
+        ASSERT_EQ(1000+i, r);
+      }
+    }
+    ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+  }
+
+  void TestNewId() {
+    uint64_t a = cache_->NewId();
+    uint64_t b = cache_->NewId();
+    ASSERT_NE(a, b);
+  }
+};
+CacheTest* CacheTest::current_;
+
+// The same tests run against the CLOCK cache, using an estimated
+// entry charge that matches the charges the tests use.
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 1);
+  }
+};
+
+TEST(CacheTest, HitAndMiss) { TestHitAndMiss(); }
+TEST(CacheTest, Erase) { TestErase(); }
+TEST(CacheTest, EntriesArePinned) { TestEntriesArePinned(); }
+TEST(CacheTest, EvictionPolicy) { TestEvictionPolicy(); }
+TEST(CacheTest, HeavyEntries) { TestHeavyEntries(); }
+TEST(CacheTest, NewId) { TestNewId(); }
+
+TEST(CacheTest, SingleShard) {
+  // With one shard, eviction follows exact LRU order
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0);
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000+i);
+  }
+  ASSERT_EQ(1000, Lookup(0));
+  Insert(kCacheSize, 1000+kCacheSize);
+  ASSERT_EQ(1000, Lookup(0));
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1002, Lookup(2));
+}
+
+TEST(CacheTest, ShardStats) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 2);
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000+i, 2);
+  }
+  for (int i = 0; i < 150; i++) {
+    Lookup(i);
+  }
+  Lookup(7);
+
+  std::vector<CacheShardStats> stats;
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(4, stats.size());
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  size_t usage = 0;
+  size_t capacity = 0;
+  for (size_t s = 0; s < stats.size(); s++) {
+    hits += stats[s].hits;
+    misses += stats[s].misses;
+    usage += stats[s].usage;
+    capacity += stats[s].capacity;
+    ASSERT_EQ(kCacheSize / 4, stats[s].capacity);
+  }
+  ASSERT_EQ(101, hits);
+  ASSERT_EQ(50, misses);
+  ASSERT_EQ(200, usage);
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), capacity);
+
+  // The default cache has 16 shards
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize);
+  stats.clear();
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(16, stats.size());
+}
 
-  Erase(100);
+TEST(CacheTest, HighPriorityIgnored) {
+  InsertHighPriority(100, 101);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
   ASSERT_EQ(-1, Lookup(100));
-  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+// The same tests run against the segmented LRU cache, in one shard so
+// that eviction order is exact.
+class SegmentedLRUCacheTest : public CacheTest {
+ public:
+  SegmentedLRUCacheTest() {
+    delete cache_;
+    cache_ = NewSegmentedLRUCache(kCacheSize, 0, 0.5);
+  }
+};
 
-  cache_->Release(h2);
-  ASSERT_EQ(2, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[1]);
-  ASSERT_EQ(102, deleted_values_[1]);
+TEST(SegmentedLRUCacheTest, SegmentedHitAndMiss) { TestHitAndMiss(); }
+TEST(SegmentedLRUCacheTest, SegmentedErase) { TestErase(); }
+TEST(SegmentedLRUCacheTest, SegmentedEntriesArePinned) {
+  TestEntriesArePinned();
+}
+TEST(SegmentedLRUCacheTest, SegmentedEvictionPolicy) { TestEvictionPolicy(); }
+TEST(SegmentedLRUCacheTest, SegmentedHeavyEntries) { TestHeavyEntries(); }
+
+TEST(SegmentedLRUCacheTest, ScanResistance) {
+  // Entries used twice survive a scan of entries used once
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000+i);
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000+i, 20000+i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(10000));
+  ASSERT_EQ(20000 + 2 * kCacheSize - 1, Lookup(10000 + 2 * kCacheSize - 1));
 }
 
-TEST(CacheTest, EvictionPolicy) {
-  Insert(100, 101);
-  Insert(200, 201);
+TEST(SegmentedLRUCacheTest, ProtectedCapacity) {
+  // Only the most recently used half of the cache stays protected
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000+i);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000+i, 20000+i);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(i < kCacheSize / 2 ? -1 : 1000+i, Lookup(i));
+  }
+}
 
-  // Frequently used entry must be kept around
-  for (int i = 0; i < kCacheSize + 100; i++) {
+TEST(SegmentedLRUCacheTest, HighPriority) {
+  InsertHighPriority(100, 101);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
     Insert(1000+i, 2000+i);
-    ASSERT_EQ(2000+i, Lookup(1000+i));
-    ASSERT_EQ(101, Lookup(100));
   }
   ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(-1, Lookup(200));
 }
 
-TEST(CacheTest, HeavyEntries) {
-  // Add a bunch of light and heavy entries and then count the combined
-  // size of items still in the cache, which must be approximately the
-  // same as the total capacity.
-  const int kLight = 1;
-  const int kHeavy = 10;
-  int added = 0;
-  int index = 0;
-  while (added < 2*kCacheSize) {
-    const int weight = (index & 1) ? kLight : kHeavy;
-    Insert(index, 1000+index, weight);
-    added += weight;
-    index++;
-  }
-
-  int cached_weight = 0;
-  for (int i = 0; i < index; i++) {
-    const int weight = (i & 1 ? kLight : kHeavy);
-    int r = Lookup(i);
-    if (r >= 0) {
-      cached_weight += weight;
-      ASSERT_EQ(1000+i, r);
+TEST(ClockCacheTest, ClockHitAndMiss) { TestHitAndMiss(); }
+TEST(ClockCacheTest, ClockErase) { TestErase(); }
+TEST(ClockCacheTest, ClockEntriesArePinned) { TestEntriesArePinned(); }
+TEST(ClockCacheTest, ClockEvictionPolicy) { TestEvictionPolicy(); }
+TEST(ClockCacheTest, ClockHeavyEntries) { TestHeavyEntries(); }
+TEST(ClockCacheTest, ClockNewId) { TestNewId(); }
+
+TEST(ClockCacheTest, PinnedEntriesAreNotEvicted) {
+  Cache::Handle* h = cache_->Insert(EncodeKey(100), EncodeValue(101), 1,
+                                    &CacheTest::Deleter);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  ASSERT_EQ(101, Lookup(100));
+  cache_->Release(h);
+}
+
+TEST(ClockCacheTest, AllEntriesPinned) {
+  // Once every slot is pinned, inserted entries are handed out without
+  // being cached, and are deleted on release.
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+    ASSERT_EQ(1000+i, DecodeValue(cache_->Value(handles.back())));
+  }
+  ASSERT_EQ(0, deleted_keys_.size());
+  for (size_t i = 0; i < handles.size(); i++) {
+    cache_->Release(handles[i]);
+  }
+  ASSERT_GT(deleted_keys_.size(), 0);
+
+  int cached = 0;
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    if (Lookup(i) >= 0) {
+      cached++;
     }
   }
-  ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+  ASSERT_EQ(4 * kCacheSize - deleted_keys_.size(), cached);
 }
 
-TEST(CacheTest, NewId) {
-  uint64_t a = cache_->NewId();
-  uint64_t b = cache_->NewId();
-  ASSERT_NE(a, b);
+namespace {
+struct ConcurrentState {
+  Cache* cache;
+  port::Mutex mu;
+  int live;         // Entries inserted but not yet deleted
+  int running;
+  bool failed;
+};
+
+static ConcurrentState* concurrent_state;
+
+static void CountingDeleter(const Slice& key, void* v) {
+  MutexLock l(&concurrent_state->mu);
+  concurrent_state->live--;
+}
+
+static void ConcurrentBody(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  Random rnd(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&rnd)));
+  bool failed = false;
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(500);
+    const std::string key = EncodeKey(k);
+    switch (rnd.Uniform(10)) {
+      case 0: {
+        {
+          MutexLock l(&state->mu);
+          state->live++;
+        }
+        state->cache->Release(state->cache->Insert(
+            key, EncodeValue(k), 1 + rnd.Uniform(4), &CountingDeleter));
+        break;
+      }
+      case 1:
+        state->cache->Erase(key);
+        break;
+      default: {
+        Cache::Handle* h = state->cache->Lookup(key);
+        if (h != NULL) {
+          failed |= (DecodeValue(state->cache->Value(h)) != k);
+          state->cache->Release(h);
+        }
+        break;
+      }
+    }
+  }
+  MutexLock l(&state->mu);
+  state->failed |= failed;
+  state->running--;
+}
+}  // namespace
+
+TEST(ClockCacheTest, Concurrent) {
+  ConcurrentState state;
+  state.cache = NewClockCache(200, 2);
+  state.live = 0;
+  state.running = 4;
+  state.failed = false;
+  concurrent_state = &state;
+  for (int i = 0; i < 4; i++) {
+    Env::Default()->StartThread(&ConcurrentBody, &state);
+  }
+  while (true) {
+    state.mu.Lock();
+    const int running = state.running;
+    state.mu.Unlock();
+    if (running == 0) {
+      break;
+    }
+    Env::Default()->SleepForMicroseconds(10000);
+  }
+  ASSERT_TRUE(!state.failed);
+  delete state.cache;
+  ASSERT_EQ(0, state.live);
 }
 
 }  // namespace leveldb
@@ -0,0 +1,393 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard keeps its entries in a fixed open-addressed table of
+// slots.  Slots are never freed while the cache exists, so Lookup() and
+// Release() can work on them without the shard's mutex: all they change
+// is a per-slot word, and only with compare-and-swap.  A lookup hit pins
+// the slot and sets its reference bit; eviction sweeps a clock hand over
+// the table, clearing reference bits and freeing unpinned slots whose
+// bit is already clear.  Insert(), Erase() and eviction hold the mutex.
+
+// The word holds the slot's state in its low two bits, the reference
+// bit above them, and the number of handles to the slot in the rest.
+enum SlotState {
+  kEmpty = 0,      // Holds no entry
+  kVisible = 1,    // Holds an entry that lookups can find
+  kInvisible = 2,  // Holds an erased or replaced entry that is still pinned
+  kFreeing = 3     // Being freed: no handles, no lookups
+};
+static const uintptr_t kStateMask = 3;
+static const uintptr_t kClockBit = 4;
+static const uintptr_t kOneRef = 8;
+
+static inline uintptr_t State(uintptr_t meta) { return meta & kStateMask; }
+static inline uintptr_t Refs(uintptr_t meta) { return meta / kOneRef; }
+
+static inline uintptr_t Load(const port::AtomicPointer& word) {
+  return reinterpret_cast<uintptr_t>(word.Acquire_Load());
+}
+
+static inline void Store(port::AtomicPointer* word, uintptr_t v) {
+  word->Release_Store(reinterpret_cast<void*>(v));
+}
+
+static inline bool CompareAndSwap(port::AtomicPointer* word,
+                                  uintptr_t expected, uintptr_t v) {
+  return word->CompareAndSwap(reinterpret_cast<void*>(expected),
+                              reinterpret_cast<void*>(v));
+}
+
+struct ClockHandle {
+  port::AtomicPointer meta;          // State, reference bit and refs
+  port::AtomicPointer displacement;  // Entries whose probes passed here
+
+  // Only written under the mutex while the slot is kEmpty, and stable
+  // while the slot is pinned or the mutex is held.
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  char* key_data;
+  size_t key_length;
+  size_t charge;
+  uint32_t hash;
+  bool detached;  // Allocated outside the table; freed by its Release()
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+
+ private:
+  // The following require mutex_ to be held.
+  ClockHandle* FindLocked(const Slice& key, uint32_t hash);
+  void Hide(ClockHandle* h);
+  void Free(ClockHandle* h);
+  void Evict(size_t charge);
+
+  // Initialized before use.
+  size_t capacity_;
+  uint32_t length_;           // Number of slots, a power of two
+  uint32_t occupancy_limit_;  // Slots in use beyond which we evict
+  ClockHandle* slots_;
+
+  // mutex_ protects the following state.
+  port::Mutex mutex_;
+  size_t usage_;
+  uint32_t occupancy_;
+  uint32_t clock_hand_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      length_(0),
+      occupancy_limit_(0),
+      slots_(NULL),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {
+}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uintptr_t meta = Load(h->meta);
+    // Error if caller has an unreleased handle
+    assert(State(meta) == kEmpty ||
+           (State(meta) == kVisible && Refs(meta) == 0));
+    if (State(meta) == kVisible) {
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge) {
+  capacity_ = capacity;
+
+  // Keep the table at most 70% full when it holds a full capacity's
+  // worth of entries of the estimated charge.  Smaller entries are
+  // evicted once 7/8 of the slots are in use.
+  if (estimated_entry_charge == 0) {
+    estimated_entry_charge = 1;
+  }
+  const uint64_t entries = capacity / estimated_entry_charge + 1;
+  length_ = 16;
+  while (length_ * 7ull < entries * 10) {
+    length_ *= 2;
+  }
+  occupancy_limit_ = length_ - length_ / 8;
+  slots_ = new ClockHandle[length_];
+  for (uint32_t i = 0; i < length_; i++) {
+    Store(&slots_[i].meta, kEmpty);
+    Store(&slots_[i].displacement, 0);
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  const uint32_t mask = length_ - 1;
+  uint32_t i = hash & mask;
+  for (uint32_t probes = 0; probes < length_; probes++) {
+    ClockHandle* h = &slots_[i];
+    uintptr_t meta = Load(h->meta);
+    // The hash may be read while an insert rewrites it, so it only
+    // serves to skip most other entries; the key is checked once the
+    // slot is pinned and can no longer change.
+    while (State(meta) == kVisible && h->hash == hash) {
+      if (CompareAndSwap(&h->meta, meta, (meta + kOneRef) | kClockBit)) {
+        if (h->hash == hash && h->key() == key) {
+          return reinterpret_cast<Cache::Handle*>(h);
+        }
+        Release(reinterpret_cast<Cache::Handle*>(h));
+        break;
+      }
+      meta = Load(h->meta);
+    }
+    if (Load(h->displacement) == 0) {
+      break;  // No entry was placed past this slot
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+  if (h->detached) {
+    (*h->deleter)(h->key(), h->value);
+    delete[] h->key_data;
+    delete h;
+    return;
+  }
+  while (true) {
+    const uintptr_t meta = Load(h->meta);
+    assert(Refs(meta) > 0);
+    if (State(meta) == kInvisible && Refs(meta) == 1) {
+      // Last handle to an entry that is no longer in the cache
+      if (CompareAndSwap(&h->meta, meta, kFreeing)) {
+        MutexLock l(&mutex_);
+        Free(h);
+        return;
+      }
+    } else if (CompareAndSwap(&h->meta, meta, meta - kOneRef)) {
+      return;
+    }
+  }
+}
+
+ClockHandle* ClockCache::FindLocked(const Slice& key, uint32_t hash) {
+  const uint32_t mask = length_ - 1;
+  uint32_t i = hash & mask;
+  for (uint32_t probes = 0; probes < length_; probes++) {
+    ClockHandle* h = &slots_[i];
+    if (State(Load(h->meta)) == kVisible &&
+        h->hash == hash && h->key() == key) {
+      return h;
+    }
+    if (Load(h->displacement) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+// Takes a visible entry out of the cache, freeing it unless handles
+// still refer to it.
+void ClockCache::Hide(ClockHandle* h) {
+  while (true) {
+    const uintptr_t meta = Load(h->meta);
+    assert(State(meta) == kVisible);
+    if (Refs(meta) == 0) {
+      if (CompareAndSwap(&h->meta, meta, kFreeing)) {
+        Free(h);
+        return;
+      }
+    } else if (CompareAndSwap(&h->meta, meta,
+                              (meta & ~kStateMask) | kInvisible)) {
+      return;
+    }
+  }
+}
+
+// REQUIRES: h is kFreeing
+void ClockCache::Free(ClockHandle* h) {
+  usage_ -= h->charge;
+  occupancy_--;
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+
+  // Undo the displacements recorded when h was inserted
+  const uint32_t mask = length_ - 1;
+  for (uint32_t i = h->hash & mask; &slots_[i] != h; i = (i + 1) & mask) {
+    Store(&slots_[i].displacement, Load(slots_[i].displacement) - 1);
+  }
+  Store(&h->meta, kEmpty);
+}
+
+void ClockCache::Evict(size_t charge) {
+  // Two sweeps clear every reference bit, so they free enough unless
+  // too many entries are pinned.
+  const uint32_t mask = length_ - 1;
+  for (uint32_t steps = 0;
+       steps < 2 * length_ &&
+           (usage_ + charge > capacity_ || occupancy_ >= occupancy_limit_);
+       steps++) {
+    ClockHandle* h = &slots_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & mask;
+    const uintptr_t meta = Load(h->meta);
+    if (State(meta) != kVisible || Refs(meta) > 0) {
+      continue;
+    }
+    if (meta & kClockBit) {
+      // Referenced since the hand last passed: give it a second chance.
+      // A concurrent lookup may make this fail, which is just as good.
+      CompareAndSwap(&h->meta, meta, meta & ~kClockBit);
+    } else if (CompareAndSwap(&h->meta, meta, kFreeing)) {
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value)) {
+  MutexLock l(&mutex_);
+
+  ClockHandle* old = FindLocked(key, hash);
+  if (old != NULL) {
+    Hide(old);
+  }
+  Evict(charge);
+
+  ClockHandle* h;
+  if (occupancy_ >= occupancy_limit_) {
+    // Every slot we may use is pinned: hand out an entry that is not
+    // cached at all, as if it had been evicted right away.
+    h = new ClockHandle;
+    h->detached = true;
+  } else {
+    const uint32_t mask = length_ - 1;
+    uint32_t i = hash & mask;
+    while (State(Load(slots_[i].meta)) != kEmpty) {
+      Store(&slots_[i].displacement, Load(slots_[i].displacement) + 1);
+      i = (i + 1) & mask;
+    }
+    h = &slots_[i];
+    h->detached = false;
+  }
+  h->value = value;
+  h->deleter = deleter;
+  h->key_data = new char[key.size()];
+  memcpy(h->key_data, key.data(), key.size());
+  h->key_length = key.size();
+  h->charge = charge;
+  h->hash = hash;
+  if (!h->detached) {
+    usage_ += charge;
+    occupancy_++;
+    // Publishes the fields above to lookups
+    Store(&h->meta, kVisible | kOneRef);
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* h = FindLocked(key, hash);
+  if (h != NULL) {
+    Hide(h);
+  }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCache shard_[kNumShards];
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) {
+    return hash >> (32 - kNumShardBits);
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].SetCapacity(per_shard, estimated_entry_charge);
+    }
+  }
+  virtual ~ShardedClockCache() { }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash)].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+}  // namespace leveldb
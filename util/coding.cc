@@ -100,6 +100,17 @@ void PutLengthPrefixedSlice(std::string* dst, const Slice& value) {
   dst->append(value.data(), value.size());
 }
 
+void PutLengthPrefixedSliceParts(std::string* dst, const SliceParts& value) {
+  size_t total = 0;
+  for (int i = 0; i < value.num_parts; i++) {
+    total += value.parts[i].size();
+  }
+  PutVarint32(dst, total);
+  for (int i = 0; i < value.num_parts; i++) {
+    dst->append(value.parts[i].data(), value.parts[i].size());
+  }
+}
+
 int VarintLength(uint64_t v) {
   int len = 1;
   while (v >= 128) {
@@ -9,6 +9,26 @@ namespace leveldb {
 Env::~Env() {
 }
 
+void Env::ScheduleHighPriority(void (*function)(void*), void* arg) {
+  Schedule(function, arg);
+}
+
+Status Env::NewMmapRandomAccessFile(const std::string& fname,
+                                    RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = NULL;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
 SequentialFile::~SequentialFile() {
 }
 
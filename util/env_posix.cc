@@ -23,6 +23,7 @@
 #include "leveldb/slice.h"
 #include "port/port.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/posix_logger.h"
 
 namespace leveldb {
@@ -89,6 +90,76 @@ class PosixRandomAccessFile: public RandomAccessFile {
   }
 };
 
+// Helper class to limit mmap file usage so that we do not end up
+// running out of virtual memory or running into kernel performance
+// problems for very large databases.
+class MmapLimiter {
+ public:
+  // Up to 1000 mmaps for 64-bit binaries; none for smaller pointer sizes.
+  MmapLimiter() : allowed_(sizeof(void*) >= 8 ? 1000 : 0) { }
+
+  // If another mmap slot is available, acquire it and return true.
+  // Else return false.
+  bool Acquire() {
+    MutexLock l(&mu_);
+    if (allowed_ <= 0) {
+      return false;
+    }
+    allowed_--;
+    return true;
+  }
+
+  // Release a slot acquired by a previous call to Acquire() that
+  // returned true.
+  void Release() {
+    MutexLock l(&mu_);
+    allowed_++;
+  }
+
+ private:
+  port::Mutex mu_;
+  int allowed_;
+
+  // No copying allowed
+  MmapLimiter(const MmapLimiter&);
+  void operator=(const MmapLimiter&);
+};
+
+// Serves reads by pointing into a read-only mapping of the whole file,
+// so no data is copied.
+class PosixMmapReadableFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  void* mmapped_region_;
+  size_t length_;
+  MmapLimiter* limiter_;
+
+ public:
+  // base[0,length-1] contains the mmapped contents of the file.
+  PosixMmapReadableFile(const std::string& fname, void* base, size_t length,
+                        MmapLimiter* limiter)
+      : filename_(fname), mmapped_region_(base), length_(length),
+        limiter_(limiter) {
+  }
+
+  virtual ~PosixMmapReadableFile() {
+    munmap(mmapped_region_, length_);
+    limiter_->Release();
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    Status s;
+    if (offset > length_ || n > length_ - offset) {
+      *result = Slice();
+      s = IOError(filename_, EINVAL);
+    } else {
+      *result = Slice(reinterpret_cast<char*>(mmapped_region_) + offset, n);
+    }
+    return s;
+  }
+};
+
 // We preallocate up to an extra megabyte and use memcpy to append new
 // data to the file.  This is safe since we either properly close the
 // file before reading from it, or for log files, the reading code
@@ -104,6 +175,8 @@ class PosixMmapFile : public WritableFile {
   char* dst_;             // Where to write next  (in range [base_,limit_])
   char* last_sync_;       // Where have we synced up to
   uint64_t file_offset_;  // Offset of base_ in file
+  uint64_t file_size_;    // Current size of the file
+  uint64_t reused_size_;  // Size of the file when it was reused, or 0
 
   // Have we done an munmap of unsynced data?
   bool pending_sync_;
@@ -143,9 +216,28 @@ class PosixMmapFile : public WritableFile {
     return result;
   }
 
+  // Extend the file to "size" bytes.  Where supported the space is
+  // allocated up front so that writes through the mapping do not have
+  // to allocate filesystem blocks one page at a time.
+  bool GrowFile(uint64_t size) {
+    assert(size > file_size_);
+#if defined(OS_LINUX)
+    if (fallocate(fd_, 0, file_size_, size - file_size_) == 0) {
+      file_size_ = size;
+      return true;
+    }
+#endif
+    if (ftruncate(fd_, size) < 0) {
+      return false;
+    }
+    file_size_ = size;
+    return true;
+  }
+
   bool MapNewRegion() {
     assert(base_ == NULL);
-    if (ftruncate(fd_, file_offset_ + map_size_) < 0) {
+    if (file_offset_ + map_size_ > file_size_ &&
+        !GrowFile(file_offset_ + map_size_)) {
       return false;
     }
     void* ptr = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
@@ -161,7 +253,11 @@ class PosixMmapFile : public WritableFile {
   }
 
  public:
-  PosixMmapFile(const std::string& fname, int fd, size_t page_size)
+  // "file_size" is the size of an existing file being reused; its
+  // contents are overwritten from the start but the file is never
+  // trimmed below that size.
+  PosixMmapFile(const std::string& fname, int fd, size_t page_size,
+                uint64_t file_size)
       : filename_(fname),
         fd_(fd),
         page_size_(page_size),
@@ -171,6 +267,8 @@ class PosixMmapFile : public WritableFile {
         dst_(NULL),
         last_sync_(NULL),
         file_offset_(0),
+        file_size_(file_size),
+        reused_size_(file_size),
         pending_sync_(false) {
     assert((page_size & (page_size - 1)) == 0);
   }
@@ -210,9 +308,14 @@ class PosixMmapFile : public WritableFile {
     size_t unused = limit_ - dst_;
     if (!UnmapCurrentRegion()) {
       s = IOError(filename_, errno);
-    } else if (unused > 0) {
-      // Trim the extra space at the end of the file
-      if (ftruncate(fd_, file_offset_ - unused) < 0) {
+    } else {
+      // Trim the extra space at the end of the file.  A reused file
+      // keeps its original size so that its blocks can be reused again.
+      uint64_t size = file_offset_ - unused;
+      if (size < reused_size_) {
+        size = reused_size_;
+      }
+      if (size < file_size_ && ftruncate(fd_, size) < 0) {
         s = IOError(filename_, errno);
       }
     }
@@ -306,6 +409,37 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         RandomAccessFile** result) {
+    *result = NULL;
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return IOError(fname, errno);
+    }
+    struct stat sbuf;
+    if (fstat(fd, &sbuf) != 0) {
+      Status s = IOError(fname, errno);
+      close(fd);
+      return s;
+    }
+    if (sbuf.st_size == 0 || !mmap_limit_.Acquire()) {
+      // Nothing to map, or too many mappings already: read normally
+      *result = new PosixRandomAccessFile(fname, fd);
+      return Status::OK();
+    }
+    Status s;
+    const size_t size = sbuf.st_size;
+    void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      *result = new PosixMmapReadableFile(fname, base, size, &mmap_limit_);
+    } else {
+      s = IOError(fname, errno);
+      mmap_limit_.Release();
+    }
+    close(fd);  // The mapping outlives the descriptor
+    return s;
+  }
+
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
     Status s;
@@ -314,7 +448,30 @@ class PosixEnv : public Env {
       *result = NULL;
       s = IOError(fname, errno);
     } else {
-      *result = new PosixMmapFile(fname, fd, page_size_);
+      *result = new PosixMmapFile(fname, fd, page_size_, 0);
+    }
+    return s;
+  }
+
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    *result = NULL;
+    Status s = RenameFile(old_fname, fname);
+    if (!s.ok()) {
+      return s;
+    }
+    // Open without O_TRUNC so that the blocks already allocated to the
+    // file are written over in place.
+    const int fd = open(fname.c_str(), O_RDWR, 0644);
+    struct stat sbuf;
+    if (fd < 0) {
+      s = IOError(fname, errno);
+    } else if (fstat(fd, &sbuf) != 0) {
+      s = IOError(fname, errno);
+      close(fd);
+    } else {
+      *result = new PosixMmapFile(fname, fd, page_size_, sbuf.st_size);
     }
     return s;
   }
@@ -411,6 +568,7 @@ class PosixEnv : public Env {
   }
 
   virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void ScheduleHighPriority(void (*function)(void*), void* arg);
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -464,67 +622,92 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
-  void BGThread();
+  // Entry per Schedule() call
+  struct BGItem { void* arg; void (*function)(void*); };
+  typedef std::deque<BGItem> BGQueue;
+
+  // A background thread and the queue of work it runs
+  struct BGThreadState {
+    PosixEnv* env;
+    pthread_cond_t bgsignal;
+    pthread_t bgthread;
+    bool started_bgthread;
+    BGQueue queue;
+  };
+
+  void ScheduleOn(BGThreadState* state, void (*function)(void*), void* arg);
+
+  // BGThread() is the body of a background thread
+  void BGThread(BGThreadState* state);
   static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
+    BGThreadState* state = reinterpret_cast<BGThreadState*>(arg);
+    state->env->BGThread(state);
     return NULL;
   }
 
   size_t page_size_;
+  MmapLimiter mmap_limit_;
   pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
-
-  // Entry per Schedule() call
-  struct BGItem { void* arg; void (*function)(void*); };
-  typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+  BGThreadState low_;   // Work passed to Schedule()
+  BGThreadState high_;  // Work passed to ScheduleHighPriority()
 };
 
-PosixEnv::PosixEnv() : page_size_(getpagesize()),
-                       started_bgthread_(false) {
+PosixEnv::PosixEnv() : page_size_(getpagesize()) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+  BGThreadState* states[] = { &low_, &high_ };
+  for (int i = 0; i < 2; i++) {
+    states[i]->env = this;
+    states[i]->started_bgthread = false;
+    PthreadCall("cvar_init", pthread_cond_init(&states[i]->bgsignal, NULL));
+  }
 }
 
 void PosixEnv::Schedule(void (*function)(void*), void* arg) {
+  ScheduleOn(&low_, function, arg);
+}
+
+void PosixEnv::ScheduleHighPriority(void (*function)(void*), void* arg) {
+  ScheduleOn(&high_, function, arg);
+}
+
+void PosixEnv::ScheduleOn(BGThreadState* state,
+                          void (*function)(void*), void* arg) {
   PthreadCall("lock", pthread_mutex_lock(&mu_));
 
   // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+  if (!state->started_bgthread) {
+    state->started_bgthread = true;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
+        pthread_create(&state->bgthread, NULL,  &PosixEnv::BGThreadWrapper,
+                       state));
   }
 
   // If the queue is currently empty, the background thread may currently be
   // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
+  if (state->queue.empty()) {
+    PthreadCall("signal", pthread_cond_signal(&state->bgsignal));
   }
 
   // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
+  state->queue.push_back(BGItem());
+  state->queue.back().function = function;
+  state->queue.back().arg = arg;
 
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
-void PosixEnv::BGThread() {
+void PosixEnv::BGThread(BGThreadState* state) {
   while (true) {
     // Wait until there is an item that is ready to run
     PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+    while (state->queue.empty()) {
+      PthreadCall("wait", pthread_cond_wait(&state->bgsignal, &mu_));
     }
 
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
+    void (*function)(void*) = state->queue.front().function;
+    void* arg = state->queue.front().arg;
+    state->queue.pop_front();
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
     (*function)(arg);
@@ -62,6 +62,36 @@ TEST(EnvPosixTest, RunMany) {
   ASSERT_EQ(4, last_id);
 }
 
+static void WaitForRelease(void* ptr) {
+  port::AtomicPointer* release = reinterpret_cast<port::AtomicPointer*>(ptr);
+  while (release->Acquire_Load() == NULL) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+}
+
+static void SetAtomic(void* ptr) {
+  reinterpret_cast<port::AtomicPointer*>(ptr)->Release_Store(ptr);
+}
+
+TEST(EnvPosixTest, HighPriorityNotBlocked) {
+  // Tie up the Schedule() thread; high priority work must still run.
+  port::AtomicPointer release(NULL);
+  port::AtomicPointer called(NULL);
+  env_->Schedule(&WaitForRelease, &release);
+  env_->ScheduleHighPriority(&SetAtomic, &called);
+  for (int i = 0; i < 100 && called.Acquire_Load() == NULL; i++) {
+    Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+  }
+  ASSERT_TRUE(called.Acquire_Load() != NULL);
+  release.Release_Store(&release);
+
+  // Afterwards the Schedule() thread carries on as before.
+  bool low_called = false;
+  env_->Schedule(&SetBool, &low_called);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(low_called);
+}
+
 struct State {
   port::Mutex mu;
   int val;
@@ -95,6 +125,37 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+TEST(EnvPosixTest, MmapReads) {
+  std::string fname = test::TmpDir() + "/env_test_mmap";
+  WritableFile* writable;
+  ASSERT_OK(env_->NewWritableFile(fname, &writable));
+  std::string data;
+  for (int i = 0; i < 10000; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_OK(writable->Append(data));
+  ASSERT_OK(writable->Close());
+  delete writable;
+
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewMmapRandomAccessFile(fname, &file));
+  char scratch[100];
+  Slice result;
+  ASSERT_OK(file->Read(5000, sizeof(scratch), &result, scratch));
+  ASSERT_EQ(data.substr(5000, sizeof(scratch)), result.ToString());
+  if (sizeof(void*) >= 8) {
+    ASSERT_TRUE(result.data() != scratch);  // Points into the mapping
+  }
+  ASSERT_OK(file->Read(data.size() - 10, 10, &result, scratch));
+  ASSERT_EQ(data.substr(data.size() - 10), result.ToString());
+
+  // Deleting the file leaves the open file readable
+  ASSERT_OK(env_->DeleteFile(fname));
+  ASSERT_OK(file->Read(0, 26, &result, scratch));
+  ASSERT_EQ("abcdefghijklmnopqrstuvwxyz", result.ToString());
+  delete file;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -17,11 +17,21 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      allow_concurrent_memtable_write(true),
+      max_write_buffer_number(2),
+      recycle_log_file_num(0),
       max_open_files(1000),
+      use_mmap_reads(false),
       block_cache(NULL),
+      block_cache_compressed(NULL),
+      row_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
-      compression(kSnappyCompression) {
+      data_block_hash_index(false),
+      index_partition_size(0),
+      compression(kSnappyCompression),
+      filter_policy(NULL),
+      prefix_extractor(NULL) {
 }
 
 
@@ -0,0 +1,93 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/prefix_extractor.h"
+
+#include <string>
+#include "leveldb/slice.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+PrefixExtractor::~PrefixExtractor() { }
+
+namespace {
+
+class FixedPrefixExtractor : public PrefixExtractor {
+ private:
+  const size_t length_;
+  std::string name_;
+
+ public:
+  explicit FixedPrefixExtractor(size_t length)
+      : length_(length),
+        name_("leveldb.FixedPrefix.") {
+    AppendNumberTo(&name_, length);
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual bool InDomain(const Slice& key) const {
+    return key.size() >= length_;
+  }
+
+  virtual Slice Transform(const Slice& key) const {
+    return Slice(key.data(), length_);
+  }
+};
+
+class DelimitedPrefixExtractor : public PrefixExtractor {
+ private:
+  const char delimiter_;
+  const int count_;
+  std::string name_;
+
+  // Return the length of the prefix of "key", or 0 if it has none
+  size_t PrefixLength(const Slice& key) const {
+    int seen = 0;
+    for (size_t i = 0; i < key.size(); i++) {
+      if (key[i] == delimiter_ && ++seen == count_) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+ public:
+  DelimitedPrefixExtractor(char delimiter, int count)
+      : delimiter_(delimiter),
+        count_(count),
+        name_("leveldb.DelimitedPrefix.") {
+    AppendNumberTo(&name_, static_cast<unsigned char>(delimiter));
+    name_.push_back('.');
+    AppendNumberTo(&name_, count);
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual bool InDomain(const Slice& key) const {
+    return PrefixLength(key) > 0;
+  }
+
+  virtual Slice Transform(const Slice& key) const {
+    return Slice(key.data(), PrefixLength(key));
+  }
+};
+
+}  // namespace
+
+const PrefixExtractor* NewFixedPrefixExtractor(size_t length) {
+  return new FixedPrefixExtractor(length);
+}
+
+const PrefixExtractor* NewDelimitedPrefixExtractor(char delimiter,
+                                                   int count) {
+  return new DelimitedPrefixExtractor(delimiter, count);
+}
+
+}  // namespace leveldb